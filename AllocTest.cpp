@@ -0,0 +1,112 @@
+#include "AllocTest.hpp"
+#include "AllocTracker.hpp"
+#include "JobSystem.hpp"
+#include "Tracer.hpp"
+
+#include <iostream>
+
+
+namespace rps
+{
+	namespace
+	{
+		struct AllocTestResult
+		{
+			uint64_t ticks = 0ull;
+			uint64_t allocatingTicks = 0ull;
+			uint64_t firstAllocatingTick = 0ull;
+			AllocStats warmup;
+			AllocStats steady;
+		};
+
+		bool startSimulation(Simulation& simulation, const AllocTestConfig& testConfig, const SnapshotFile& file, JobSystem& jobs)
+		{
+			simulation.setJobSystem(&jobs);
+			if (!testConfig.snapshotName.empty())
+				return simulation.loadSnapshot(file);
+
+			simulation.configure(testConfig.simulation, testConfig.seed);
+			simulation.insertObjects(Simulation::generateObjects(testConfig.simulation, PlacementConfig(), simulation.getNextSeed(), &jobs));
+			return true;
+		}
+
+		AllocTestResult runMode(Simulation& simulation, const AllocTestConfig& testConfig)
+		{
+			ALLOC_PHASE(Simulation);
+			AllocTestResult result;
+
+			AllocStats before = AllocTracker::getTotal();
+			for (uint64_t tick = 0ull; tick < testConfig.warmupTicks; ++tick)
+			{
+				simulation.step(testConfig.timeStep);
+			}
+			result.warmup = AllocTracker::getTotal() - before;
+
+			AllocStats steadyBefore = AllocTracker::getTotal();
+			for (; result.ticks < testConfig.ticks; ++result.ticks)
+			{
+				uint64_t allocations = AllocTracker::getTotal().allocations;
+				simulation.step(testConfig.timeStep);
+				if (AllocTracker::getTotal().allocations == allocations)
+					continue;
+				if (result.allocatingTicks == 0ull)
+					result.firstAllocatingTick = simulation.getTick();
+				++result.allocatingTicks;
+			}
+			result.steady = AllocTracker::getTotal() - steadyBefore;
+			return result;
+		}
+	}
+
+	bool runAllocTest(const AllocTestConfig& testConfig)
+	{
+		TRACE_SCOPE("AllocTest");
+		SnapshotFile file;
+		if (!testConfig.snapshotName.empty())
+		{
+			if (!file.open(testConfig.snapshotName))
+				return false;
+			if (file.getHeader().types > MAX_TYPES)
+			{
+				std::cout << testConfig.snapshotName << " has more types than this build supports" << std::endl;
+				return false;
+			}
+		}
+
+		JobSystemConfig jobConfig;
+		jobConfig.threads = testConfig.threads;
+		JobSystem jobs;
+		jobs.start(jobConfig);
+
+		std::cout << "Checking that simulation ticks do not allocate: " << testConfig.warmupTicks << " warmup and "
+			<< testConfig.ticks << " measured ticks per steering mode on " << jobs.getThreadCount() << " threads..." << std::endl << std::endl;
+		std::cout << "Steering\tWarmup\tSteady\tBytes\tTicks\tFirst\tResult" << std::endl;
+
+		bool isSuccess = true;
+		for (bool isFlowField : { false, true })
+		{
+			Simulation simulation;
+			if (!startSimulation(simulation, testConfig, file, jobs))
+			{
+				std::cout << "Failed to start the simulation" << std::endl;
+				return false;
+			}
+			simulation.setFlowField(isFlowField);
+
+			AllocTestResult result = runMode(simulation, testConfig);
+			bool isPassed = result.steady.allocations == 0ull;
+			isSuccess = isSuccess && isPassed;
+
+			std::cout << (isFlowField ? "Flow Field" : "Exact\t") << '\t' << result.warmup.allocations << '\t'
+				<< result.steady.allocations << '\t' << result.steady.bytes << '\t' << result.allocatingTicks << '\t';
+			if (result.allocatingTicks != 0ull)
+				std::cout << result.firstAllocatingTick;
+			else
+				std::cout << '-';
+			std::cout << '\t' << (isPassed ? "OK" : "FAILED") << std::endl;
+		}
+
+		std::cout << std::endl << (isSuccess ? "No allocations in steady-state ticks" : "Steady-state ticks allocated") << std::endl;
+		return isSuccess;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "Simulation.hpp"
+
+#include <cstdint>
+#include <string>
+
+
+namespace rps
+{
+	struct AllocTestConfig
+	{
+		// Starts from this snapshot when set, otherwise from a match generated from `simulation`
+		std::string snapshotName;
+		SimulationConfig simulation;
+		uint32_t seed = 1u;
+
+		// Job system threads, 0 uses every hardware thread
+		size_t threads = 0ull;
+
+		uint64_t warmupTicks = 240ull;
+		uint64_t ticks = 1440ull;
+		float timeStep = 1.0f / 144.0f;
+	};
+
+
+	// Headless: runs the match once per steering mode and fails if any tick after the warmup
+	// allocates. The warmup lets arrays that are sized lazily reach their final capacity.
+	bool runAllocTest(const AllocTestConfig&);
+}
@@ -0,0 +1,165 @@
+#include "AllocTracker.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+namespace rps
+{
+	namespace
+	{
+		// One cache line per phase, so threads in different phases do not contend
+		struct alignas(64) PhaseCounters
+		{
+			std::atomic<uint64_t> allocations{ 0ull };
+			std::atomic<uint64_t> frees{ 0ull };
+			std::atomic<uint64_t> bytes{ 0ull };
+		};
+
+		// Constant-initialized: allocations made before main() are counted too
+		PhaseCounters counters[static_cast<size_t>(AllocPhase::Count)];
+		thread_local AllocPhase threadPhase = AllocPhase::Other;
+
+		void* allocate(size_t size)
+		{
+			void* pointer = std::malloc(size != 0ull ? size : 1ull);
+			if (pointer != nullptr)
+				AllocTracker::recordAllocation(size);
+			return pointer;
+		}
+
+		void deallocate(void* pointer)
+		{
+			if (pointer == nullptr)
+				return;
+			AllocTracker::recordFree();
+			std::free(pointer);
+		}
+	}
+
+	const char* getAllocPhaseName(AllocPhase phase)
+	{
+		switch (phase)
+		{
+		case AllocPhase::Other:
+			return "Other";
+		case AllocPhase::Events:
+			return "Events";
+		case AllocPhase::Simulation:
+			return "Simulation";
+		case AllocPhase::Render:
+			return "Render";
+		case AllocPhase::Audio:
+			return "Audio";
+		default:
+			return "Unknown";
+		}
+	}
+
+	void AllocTracker::setPhase(AllocPhase phase)
+	{
+		threadPhase = phase;
+	}
+
+	AllocPhase AllocTracker::getPhase()
+	{
+		return threadPhase;
+	}
+
+	AllocStats AllocTracker::getStats(AllocPhase phase)
+	{
+		const PhaseCounters& phaseCounters = counters[static_cast<size_t>(phase)];
+		AllocStats stats;
+		stats.allocations = phaseCounters.allocations.load(std::memory_order_relaxed);
+		stats.frees = phaseCounters.frees.load(std::memory_order_relaxed);
+		stats.bytes = phaseCounters.bytes.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	AllocStats AllocTracker::getTotal()
+	{
+		AllocStats total;
+		for (uint8_t phase = 0u; phase < static_cast<uint8_t>(AllocPhase::Count); ++phase)
+		{
+			AllocStats stats = getStats(static_cast<AllocPhase>(phase));
+			total.allocations += stats.allocations;
+			total.frees += stats.frees;
+			total.bytes += stats.bytes;
+		}
+		return total;
+	}
+
+	void AllocTracker::recordAllocation(size_t bytes)
+	{
+		PhaseCounters& phaseCounters = counters[static_cast<size_t>(threadPhase)];
+		phaseCounters.allocations.fetch_add(1ull, std::memory_order_relaxed);
+		phaseCounters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	void AllocTracker::recordFree()
+	{
+		counters[static_cast<size_t>(threadPhase)].frees.fetch_add(1ull, std::memory_order_relaxed);
+	}
+}
+
+// --------------------------------Global Operators--------------------------------
+
+// Over-aligned (C++17 std::align_val_t) forms are left to the runtime and are not counted;
+// nothing in the game allocates over-aligned types on the heap.
+
+void* operator new(size_t size)
+{
+	void* pointer = rps::allocate(size);
+	if (pointer == nullptr)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](size_t size)
+{
+	void* pointer = rps::allocate(size);
+	if (pointer == nullptr)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return rps::allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return rps::allocate(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	rps::deallocate(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	rps::deallocate(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	rps::deallocate(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+	rps::deallocate(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	rps::deallocate(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	rps::deallocate(pointer);
+}
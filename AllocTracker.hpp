@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+
+// Every heap allocation goes through the replaced global operator new/delete in AllocTracker.cpp
+// and is counted under the phase its thread is in. Counting is two relaxed atomic adds,
+// so it stays on in every build.
+#define RPS_ALLOC_JOIN_IMPL(a, b) a##b
+#define RPS_ALLOC_JOIN(a, b) RPS_ALLOC_JOIN_IMPL(a, b)
+#define ALLOC_PHASE(phase) rps::AllocPhaseScope RPS_ALLOC_JOIN(allocPhase, __LINE__)(rps::AllocPhase::phase)
+
+
+namespace rps
+{
+	enum class AllocPhase : uint8_t
+	{
+		Other,
+		Events,
+		Simulation,
+		Render,
+		Audio,
+		Count
+	};
+
+	const char* getAllocPhaseName(AllocPhase);
+
+
+	struct AllocStats
+	{
+		uint64_t allocations = 0ull;
+		uint64_t frees = 0ull;
+		uint64_t bytes = 0ull;
+
+		AllocStats operator-(const AllocStats& other) const
+		{
+			return AllocStats{ allocations - other.allocations, frees - other.frees, bytes - other.bytes };
+		}
+	};
+
+
+	// Counters only ever grow: measure a span by subtracting the stats taken before it
+	class AllocTracker
+	{
+	public:
+		static void setPhase(AllocPhase);
+		static AllocPhase getPhase();
+
+		static AllocStats getStats(AllocPhase);
+		static AllocStats getTotal();
+
+		static void recordAllocation(size_t bytes);
+		static void recordFree();
+	};
+
+
+	class AllocPhaseScope
+	{
+	public:
+		explicit AllocPhaseScope(AllocPhase phase)
+			: previous(AllocTracker::getPhase())
+		{
+			AllocTracker::setPhase(phase);
+		}
+
+		~AllocPhaseScope()
+		{
+			AllocTracker::setPhase(previous);
+		}
+
+		AllocPhaseScope(const AllocPhaseScope&) = delete;
+		AllocPhaseScope& operator=(const AllocPhaseScope&) = delete;
+
+	private:
+		AllocPhase previous;
+	};
+}
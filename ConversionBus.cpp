@@ -0,0 +1,125 @@
+#include "ConversionBus.hpp"
+#include "Tracer.hpp"
+
+#include <chrono>
+#include <cstring>
+
+
+namespace rps
+{
+// --------------------------------Conversion Bus--------------------------------
+
+	ConversionBus::ConversionBus(size_t requestedCapacity)
+	{
+		capacity = 1ull;
+		while (capacity < requestedCapacity)
+		{
+			capacity <<= 1u;
+		}
+		mask = capacity - 1ull;
+
+		slots.reset(new Slot[capacity]);
+		for (size_t i = 0ull; i < capacity; ++i)
+		{
+			slots[i].sequence.store(0ull, std::memory_order_relaxed);
+		}
+		head.store(0ull, std::memory_order_relaxed);
+	}
+
+	void ConversionBus::publish(const ConversionEvent& event)
+	{
+		uint64_t index = head.load(std::memory_order_relaxed);
+		Slot& slot = slots[index & mask];
+
+		uint32_t x, y;
+		std::memcpy(&x, &event.x, sizeof(x));
+		std::memcpy(&y, &event.y, sizeof(y));
+
+		slot.sequence.store(index * 2ull + 1ull, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.words[0].store(event.tick << 16u | static_cast<uint64_t>(event.hunterType) << 8u | event.victimType, std::memory_order_relaxed);
+		slot.words[1].store(event.hunterId | static_cast<uint64_t>(event.victimId) << 32u, std::memory_order_relaxed);
+		slot.words[2].store(x | static_cast<uint64_t>(y) << 32u, std::memory_order_relaxed);
+		slot.sequence.store(index * 2ull + 2ull, std::memory_order_release);
+
+		head.store(index + 1ull, std::memory_order_release);
+	}
+
+	bool ConversionBus::poll(Cursor& cursor, ConversionEvent& event) const
+	{
+		while (true)
+		{
+			uint64_t published = head.load(std::memory_order_acquire);
+			if (cursor.next >= published)
+				return false;
+			if (published - cursor.next > capacity)
+			{
+				cursor.dropped += published - capacity - cursor.next;
+				cursor.next = published - capacity;
+			}
+
+			const Slot& slot = slots[cursor.next & mask];
+			uint64_t expected = cursor.next * 2ull + 2ull;
+			uint64_t before = slot.sequence.load(std::memory_order_acquire);
+			uint64_t words[3] = {
+				slot.words[0].load(std::memory_order_relaxed),
+				slot.words[1].load(std::memory_order_relaxed),
+				slot.words[2].load(std::memory_order_relaxed)
+			};
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+			++cursor.next;
+
+			if (before != expected || after != expected)
+			{
+				++cursor.dropped;
+				continue;
+			}
+
+			uint32_t x = static_cast<uint32_t>(words[2]);
+			uint32_t y = static_cast<uint32_t>(words[2] >> 32u);
+			event.tick = words[0] >> 16u;
+			event.hunterType = static_cast<uint8_t>(words[0] >> 8u);
+			event.victimType = static_cast<uint8_t>(words[0]);
+			event.hunterId = static_cast<uint32_t>(words[1]);
+			event.victimId = static_cast<uint32_t>(words[1] >> 32u);
+			std::memcpy(&event.x, &x, sizeof(x));
+			std::memcpy(&event.y, &y, sizeof(y));
+			return true;
+		}
+	}
+
+// --------------------------------Conversion Consumer--------------------------------
+
+	ConversionConsumer::ConversionConsumer(const ConversionBus& source, const char* threadName, std::function<void(const ConversionEvent&)> onEvent, std::function<void()> onIdle)
+		: bus(source), name(threadName), handler(std::move(onEvent)), idle(std::move(onIdle)), isRunning(true), dropped(0ull)
+	{
+		thread = std::thread(&ConversionConsumer::run, this);
+	}
+
+	ConversionConsumer::~ConversionConsumer()
+	{
+		isRunning.store(false, std::memory_order_relaxed);
+		thread.join();
+	}
+
+	void ConversionConsumer::run()
+	{
+		TRACE_THREAD_NAME(name);
+		ConversionBus::Cursor cursor = bus.getCursor();
+		ConversionEvent event;
+		while (isRunning.load(std::memory_order_relaxed))
+		{
+			TRACE_SCOPE("Drain");
+			for (size_t handled = 0ull; handled < 1024ull && bus.poll(cursor, event); ++handled)
+			{
+				handler(event);
+			}
+			dropped.store(cursor.dropped, std::memory_order_relaxed);
+
+			if (idle)
+				idle();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
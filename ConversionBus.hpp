@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+
+
+namespace rps
+{
+	struct ConversionEvent
+	{
+		uint64_t tick;
+		uint32_t hunterId;
+		uint32_t victimId;
+		uint8_t hunterType;
+		uint8_t victimType;
+		float x;
+		float y;
+	};
+
+
+	// Single-producer ring of conversion events. The producer never waits: it overwrites the
+	// oldest slot, and every consumer keeps its own cursor and counts what it missed.
+	// Slots are seqlocked and their payload is packed into atomic words, so a consumer
+	// racing the producer detects the overwrite instead of reading a torn event.
+	class ConversionBus
+	{
+	public:
+		struct Cursor
+		{
+			uint64_t next = 0ull;
+			uint64_t dropped = 0ull;
+		};
+
+		explicit ConversionBus(size_t capacity);
+
+		void publish(const ConversionEvent&);
+		bool poll(Cursor&, ConversionEvent&) const;
+
+		uint64_t getPublished() const { return head.load(std::memory_order_acquire); }
+		Cursor getCursor() const { return Cursor{ getPublished(), 0ull }; }
+
+	private:
+		struct Slot
+		{
+			std::atomic<uint64_t> sequence;
+			std::atomic<uint64_t> words[3];
+		};
+
+		std::unique_ptr<Slot[]> slots;
+		size_t capacity;
+		size_t mask;
+		std::atomic<uint64_t> head;
+	};
+
+
+	// Drains a ConversionBus on its own thread, calling the handler for every event it gets
+	class ConversionConsumer
+	{
+	public:
+		ConversionConsumer(const ConversionBus&, const char* name, std::function<void(const ConversionEvent&)>, std::function<void()> idle = nullptr);
+		~ConversionConsumer();
+
+		uint64_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+	private:
+		const ConversionBus& bus;
+		const char* name;
+		std::function<void(const ConversionEvent&)> handler;
+		std::function<void()> idle;
+		std::atomic<bool> isRunning;
+		std::atomic<uint64_t> dropped;
+		std::thread thread;
+
+		void run();
+	};
+}
@@ -3,9 +3,10 @@
 
 namespace rps
 {
-	Engine::Engine()
+	Engine::Engine(const std::string& snapshotName, const ArenaConfig& newArenaConfig)
 	{
 		config = WindowConfig{};
+		arenaConfig = newArenaConfig;
 
 		settings.antialiasingLevel = config.antialiasingLevel;
 		window = new sf::RenderWindow(sf::VideoMode(config.width, config.height), config.name, sf::Style::Default, settings);
@@ -15,32 +16,22 @@ namespace rps
 		loadSettings();
 		loadPresets();
 		setFullscreen();
-		for (uint8_t type = ROCK; type < types; ++type)
-		{
-			objects.push_back(std::vector<sf::RectangleShape*>());
-			objects[type].reserve(count * types);
-			for (size_t i = 0ull; i < count; ++i)
-			{
-				sf::RectangleShape* object = createObject(getRandomPos(), size, type);
-				objects[type].push_back(object);
-			}
-		}
 
-		playIntro();
+		if (arenaConfig.arenas > 1ull)
+			setArenas();
+		else if (snapshotName.empty() || !loadSnapshot(snapshotName))
+			restart();
+		updateAllocStats();
 	}
 
 	Engine::~Engine()
 	{
+		stopConsumers();
+		if (pendingObjects.valid())
+			pendingObjects.wait();
+		jobs.stop();
 		delete window;
 
-		for (uint8_t type = ROCK; type < types; ++type)
-		{
-			for (auto object : objects[type])
-			{
-				delete object;
-			}
-		}
-
 		for (auto texture : textures)
 		{
 			delete texture;
@@ -55,13 +46,11 @@ namespace rps
 			}
 		}
 		delete introSound;
-
-		clearSoundPoll();
-		clearSoundHeap();
 	}
 
 	void Engine::setFullscreen()
 	{
+		TRACE_SCOPE("setFullscreen");
 		sf::Vector2u maxSize(GetSystemMetrics(SM_CXSCREEN), GetSystemMetrics(SM_CYSCREEN));
 		sf::Vector2u size(maxSize);
 		sf::Vector2i winPos(0, 0);
@@ -82,6 +71,7 @@ namespace rps
 
 		winSize = window->getSize();
 
+		setCamera();
 		setIntro();
 		setControlsTab();
 		setDebugString();
@@ -89,30 +79,56 @@ namespace rps
 
 	void Engine::playIntro()
 	{
+		TRACE_SCOPE("playIntro");
 		if (introSound != nullptr)
 			introSound->play();
 
-		window->clear();
+		isIntro = true;
+		introStep = 0ull;
+		introTime = 0.0l;
+		introPreview.setTexture(textures[ROCK]);
+	}
 
-		std::vector<int64_t> delays{ 500, 433, 700 };
-		for (uint8_t type = ROCK; type < types; ++type)
+	void Engine::updateIntro()
+	{
+		introTime += deltaTime;
+		while (introStep < introDelays.size() && introTime >= introDelays[introStep])
 		{
-			if (type == SCISSORS)
-			{
-				introPreview.setTexture(textures[type]);
-				window->draw(introPreview);
-				window->display();
-			}
-			introPreview.setTexture(textures[type]);
-			window->draw(introPreview);
-			window->display();
-			window->clear();
-			sleep(delays[type]);
+			introTime -= introDelays[introStep];
+			++introStep;
+		}
+
+		if (introStep >= std::min(introDelays.size(), static_cast<size_t>(types)))
+		{
+			finishIntro();
+			return;
 		}
+		introPreview.setTexture(textures[introStep]);
+	}
+
+	void Engine::finishIntro()
+	{
+		TRACE_SCOPE("finishIntro");
+		isIntro = false;
+
+		simulation.insertObjects(pendingObjects.get());
 	}
 
 // --------------------------------Load Presets--------------------------------
 
+	SimulationConfig getSimulationConfig(const GameSettings& gameSettings)
+	{
+		SimulationConfig simulationConfig;
+		simulationConfig.types = gameSettings.types;
+		simulationConfig.count = gameSettings.count;
+		simulationConfig.speed = gameSettings.speed;
+		simulationConfig.size = gameSettings.size;
+		simulationConfig.worldSize = sf::Vector2f(static_cast<float>(gameSettings.worldWidth), static_cast<float>(gameSettings.worldHeight));
+		simulationConfig.isFlowField = gameSettings.isFlowField;
+		simulationConfig.flowCellSize = gameSettings.flowCellSize;
+		return simulationConfig;
+	}
+
 	void Engine::loadSettings()
 	{
 		timeCounter = 0.0l;
@@ -122,11 +138,47 @@ namespace rps
 		isF3Menu = false;
 		isControlsTab = true;
 
-		size = gameSettings.size;
-		count = gameSettings.count;
-		speed = gameSettings.speed;
+		isIntro = false;
+		introDelays = { 0.5l, 0.433l, 0.7l };
+		introSound = nullptr;
+
+		JobSystemConfig jobConfig;
+		jobConfig.threads = gameSettings.jobThreads;
+		jobConfig.isPinned = gameSettings.isJobPinning;
+		jobs.start(jobConfig);
+
 		types = gameSettings.types;
 		volume = gameSettings.volume;
+		simulation.configure(getSimulationConfig(gameSettings), static_cast<uint32_t>(rand()));
+		simulation.setJobSystem(&jobs);
+		placement.distribution = gameSettings.distribution;
+		bulkCount = gameSettings.bulkCount;
+
+		worldSize = simulation.getConfig().worldSize;
+		cameraZoom = 0.0f;
+		isCameraDrag = false;
+		renderGrids.resize(types);
+		renderGridObjects.assign(types, 0ull);
+		renderGridLayout = UINT64_MAX;
+		renderGridTick = 0ull;
+		renderGridSize = 0.0f;
+		renderGridDrift = 0.0f;
+		selectedArena = 0ull;
+
+		deltaTime = 1.0l / FPSLimit;
+		simulationStep = deltaTime;
+
+		isHistoryGraph = false;
+		history.configure(types, gameSettings.historyCapacity, gameSettings.historyLevels, gameSettings.historyFactor);
+
+		isGovernor = gameSettings.isGovernor;
+		governorConfig.maxSoundVoices = MAX_MIXER_VOICES;
+		governor.configure(governorConfig, 1.0f / FPSLimit);
+		governor.setEnabled(isGovernor);
+		retargetInterval = governor.getLevels().retargetInterval;
+		renderLOD = governor.getLevels().renderLOD;
+		soundVoices = governor.getLevels().soundVoices;
+		simulation.setRetargetInterval(retargetInterval);
 	}
 
 	void Engine::loadPresets()
@@ -145,11 +197,14 @@ namespace rps
 		setIntro();
 
 		loadSounds();
-		soundPoll.reserve(140ull);
+		setMixer();
+
+		startConsumers();
 	}
 
 	void Engine::loadFont()
 	{
+		TRACE_SCOPE("loadFont");
 		fontName = "minecraft.ttf";
 		std::cout << "Loading font..." << std::endl;
 		if (!font.loadFromFile("./Font/" + fontName))
@@ -172,21 +227,66 @@ namespace rps
 		window->setIcon(icon.getSize().x, icon.getSize().y, icon.getPixelsPtr());
 	}
 
+	sf::Color getAverageColor(const sf::Image& image)
+	{
+		uint64_t r = 0ull, g = 0ull, b = 0ull, opaque = 0ull;
+		for (unsigned int y = 0u; y < image.getSize().y; ++y)
+		{
+			for (unsigned int x = 0u; x < image.getSize().x; ++x)
+			{
+				sf::Color pixel = image.getPixel(x, y);
+				if (pixel.a < 128u)
+					continue;
+				r += pixel.r;
+				g += pixel.g;
+				b += pixel.b;
+				++opaque;
+			}
+		}
+		if (opaque == 0ull)
+			return sf::Color::Magenta;
+		return sf::Color(static_cast<uint8_t>(r / opaque), static_cast<uint8_t>(g / opaque), static_cast<uint8_t>(b / opaque));
+	}
+
+	// Files are decoded and averaged on the job system; textures are created here, on the thread that owns the window
 	void Engine::loadTextures()
 	{
+		TRACE_SCOPE("loadTextures");
 		createErrorTexture();
 		textureNames = { "raw_iron.png", "paper.png", "shears.png" };
 		std::cout << "Loading textures..." << std::endl;
-		for (auto textureName : textureNames)
+
+		std::vector<sf::Image> images(textureNames.size());
+		std::vector<uint8_t> isDecoded(textureNames.size(), 0u);
+		typeColors.assign(textureNames.size(), sf::Color::Magenta);
+		TaskGraph graph;
+		for (size_t i = 0ull; i < textureNames.size(); ++i)
+		{
+			TaskGraph::Task decode = graph.add([&, i]()
+			{
+				isDecoded[i] = images[i].loadFromFile("./Textures/" + textureNames[i]) ? 1u : 0u;
+			});
+			TaskGraph::Task average = graph.add([&, i]()
+			{
+				if (isDecoded[i])
+					typeColors[i] = getAverageColor(images[i]);
+			});
+			graph.precede(decode, average);
+		}
+		jobs.run(graph);
+
+		for (size_t i = 0ull; i < textureNames.size(); ++i)
 		{
 			sf::Texture* texture = new sf::Texture();
-			if (!texture->loadFromFile("./Textures/" + textureName))
+			if (!isDecoded[i] || !texture->loadFromImage(images[i]))
 			{
-				std::cout << "Failed to load " << textureName << std::endl;
+				std::cout << "Failed to load " << textureNames[i] << std::endl;
+				delete texture;
 				textures.push_back(errorTexture);
+				typeColors[i] = sf::Color::Magenta;
 				continue;
 			}
-			std::cout << textureName << " was loaded successfully" << std::endl;
+			std::cout << textureNames[i] << " was loaded successfully" << std::endl;
 			textures.push_back(texture);
 		}
 		std::cout << "Done." << std::endl << std::endl;
@@ -206,6 +306,7 @@ namespace rps
 
 	void Engine::loadSounds()
 	{
+		TRACE_SCOPE("loadSounds");
 		soundNames = {
 			{ "Stone_dig1.ogg", "Stone_dig2.ogg", "Stone_dig3.ogg", "Stone_dig4.ogg" },
 			{ "Grass_hit1.ogg", "Grass_hit2.ogg", "Grass_hit3.ogg", "Grass_hit4.ogg", "Grass_hit5.ogg", "Grass_hit6.ogg"},
@@ -213,20 +314,45 @@ namespace rps
 		};
 		
 		std::cout << "Loading sounds..." << std::endl;
+		std::vector<std::pair<uint8_t, size_t>> clips;
+		std::vector<std::vector<sf::SoundBuffer*>> loaded(types);
+		for (uint8_t type = ROCK; type < types; ++type)
+		{
+			loaded[type].resize(soundNames[type].size(), nullptr);
+			for (size_t i = 0ull; i < soundNames[type].size(); ++i)
+			{
+				clips.push_back(std::make_pair(type, i));
+			}
+		}
+
+		// Decoded on the job system, reported afterwards in order
+		jobs.parallelFor(clips.size(), 1ull, [&](size_t first, size_t last)
+		{
+			for (size_t clip = first; clip < last; ++clip)
+			{
+				uint8_t type = clips[clip].first;
+				size_t i = clips[clip].second;
+				sf::SoundBuffer* soundBuffer = new sf::SoundBuffer;
+				if (soundBuffer->loadFromFile("./Sounds/" + soundNames[type][i]))
+					loaded[type][i] = soundBuffer;
+				else
+					delete soundBuffer;
+			}
+		});
+
 		for (uint8_t type = ROCK; type < types; ++type)
 		{
 			std::cout << static_cast<int>(type) << ':' << std::endl;
 			soundBuffers.push_back(std::vector<sf::SoundBuffer*>());
-			for (auto soundName : soundNames[type])
+			for (size_t i = 0ull; i < soundNames[type].size(); ++i)
 			{
-				sf::SoundBuffer* soundBuffer = new sf::SoundBuffer;
-				if (!soundBuffer->loadFromFile("./Sounds/" + soundName))
+				if (loaded[type][i] == nullptr)
 				{
-					std::cout << "\tFailed to load " << soundName << std::endl;
+					std::cout << "\tFailed to load " << soundNames[type][i] << std::endl;
 					continue;
 				}
-				std::cout << '\t' << soundName << " was loaded successfully" << std::endl;
-				soundBuffers[type].push_back(soundBuffer);
+				std::cout << '\t' << soundNames[type][i] << " was loaded successfully" << std::endl;
+				soundBuffers[type].push_back(loaded[type][i]);
 			}
 		}
 
@@ -243,6 +369,22 @@ namespace rps
 		std::cout << "Done." << std::endl << std::endl;
 	}
 
+	void Engine::setMixer()
+	{
+		mixer.setup(2u, MIXER_SAMPLE_RATE, MAX_MIXER_VOICES, MIXER_BLOCK_FRAMES);
+		for (uint8_t type = ROCK; type < types; ++type)
+		{
+			soundClips.push_back(std::vector<size_t>());
+			for (auto soundBuffer : soundBuffers[type])
+			{
+				soundClips[type].push_back(mixer.addClip(*soundBuffer));
+			}
+		}
+		mixer.setVoiceLimit(soundVoices);
+		mixer.setMasterVolume(volume);
+		mixer.play();
+	}
+
 	void Engine::setIntro()
 	{
 		size_t minSize = std::min(winSize.x, winSize.y);
@@ -287,7 +429,26 @@ namespace rps
 			"Speed:\n"
 			"Size:\n"
 			"Volume:\n"
-			"Count:",
+			"Count:\n"
+			"Steering:\n"
+			"Spawn:\n"
+			"Tick:\n"
+			"Arena:\n"
+			"\n"
+			"Converted:\n"
+			"Rate:\n"
+			"Dropped:\n"
+			"\n"
+			"Governor:\n"
+			"Frame:\n"
+			"Retarget:\n"
+			"LOD:\n"
+			"Voices:\n"
+			"AA:\n"
+			"Threads:\n"
+			"\n"
+			"Allocs:\n"
+			"By Phase:",
 
 			"(There must be stats of first panel)"
 		};
@@ -297,7 +458,7 @@ namespace rps
 			sf::Vector2f(128.0f, 32.0f)
 		};
 
-		controlsTab.clear();
+		F3Menu.clear();
 		for (size_t i = 0ull; i < panelPoses.size(); ++i)
 		{
 			F3Menu.push_back(sf::Text());
@@ -329,12 +490,25 @@ namespace rps
 			"|                                                                      |\n"
 			"|                                                                      |\n"
 			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
+			"|                                                                      |\n"
 			"\\______________________/",
 
 			"Esc\n"
 			"F3\n"
 			"F11\n"
 			"R\n"
+			"Tab\n"
 			"1/4\n"
 			"2/5\n"
 			"3/6\n"
@@ -342,6 +516,17 @@ namespace rps
 			"S/W\n"
 			"D/E\n"
 			"Z/X\n"
+			"Shift\n"
+			"V\n"
+			"F\n"
+			"G\n"
+			"L\n"
+			"H\n"
+			"P\n"
+			"F5/F9\n"
+			"Drag\n"
+			"Home\n"
+			"Click\n"
 			"C\n"
 			"",
 
@@ -349,6 +534,7 @@ namespace rps
 			"->    F3 Menu\n"
 			"->    Fullscreen\n"
 			"->    Restart\n"
+			"->    Skip Intro\n"
 			"->    -/+ Rocks\n"
 			"->    -/+ Papers\n"
 			"->    -/+ Scissors\n"
@@ -356,6 +542,17 @@ namespace rps
 			"->    -/+ Size\n"
 			"->    -/+ Volume\n"
 			"->    -/+ Count\n"
+			"->    With 1-6/Z/X: Bulk\n"
+			"->    Spawn Distribution\n"
+			"->    Steering\n"
+			"->    Governor\n"
+			"->    Log Conversions\n"
+			"->    History Graph\n"
+			"->    Export History\n"
+			"->    Quicksave/Quickload\n"
+			"->    Pan (Wheel: Zoom)\n"
+			"->    Reset Camera\n"
+			"->    Select Arena (Arrows too)\n"
 			"->    Close Tab\n"
 			""
 		};
@@ -366,6 +563,7 @@ namespace rps
 			sf::Vector2f(100.0f, getHeightOfBottomPanel(panelContent[2]) - 20.0f)
 		};
 
+		controlsTab.clear();
 		for (size_t i = 0ull; i < panelPoses.size(); ++i)
 		{
 			controlsTab.push_back(sf::Text());
@@ -390,227 +588,880 @@ namespace rps
 
 // --------------------------------Commands--------------------------------
 
-	void Engine::addObject(uint8_t type)
+	void Engine::spawnObjects(uint8_t type, bool isBulk)
 	{
-		sf::RectangleShape* object = createObject(getRandomPos(), size, type);
-		objects[type].push_back(object);
+		if (isBulk)
+			getControlledSimulation().spawnObjects(type, bulkCount, placement);
+		else
+			getControlledSimulation().addObject(type);
 	}
 
-	void Engine::deleteObject(uint8_t type)
+	void Engine::despawnObjects(uint8_t type, bool isBulk)
 	{
-		if (objects[type].size() == 0ull)
-			return;
-		size_t randomIndex = rand() % objects[type].size();
-		delete objects[type][randomIndex];
-		objects[type].erase(objects[type].begin() + randomIndex);
+		if (isBulk)
+			getControlledSimulation().despawnObjects(type, bulkCount);
+		else
+			getControlledSimulation().deleteObject(type);
+	}
+
+	void Engine::switchDistribution()
+	{
+		placement.distribution = static_cast<Distribution>((static_cast<uint8_t>(placement.distribution) + 1u) % static_cast<uint8_t>(Distribution::Count));
+		gameSettings.distribution = placement.distribution;
 	}
 
 	void Engine::changeSpeed(float change)
 	{
-		speed = std::fmaxf(-512.0f, std::fminf(speed + change, 512.0f));
-		gameSettings.speed = speed;
+		Simulation& controlled = getControlledSimulation();
+		float speed = std::fmaxf(-512.0f, std::fminf(controlled.getConfig().speed + change, 512.0f));
+		controlled.setSpeed(speed);
+		getControlledSettings().speed = speed;
 	}
 
 	void Engine::changeCount(int64_t change)
 	{
-		count = std::max(1ll, std::min(static_cast<int64_t>(count) + change, 512ll));
-		gameSettings.count = count;
+		Simulation& controlled = getControlledSimulation();
+		size_t count = std::max(1ll, std::min(static_cast<int64_t>(controlled.getConfig().count) + change, MAX_OBJECT_COUNT));
+		controlled.setCount(count);
+		getControlledSettings().count = count;
 	}
 
 	void Engine::changeSize(float change)
 	{
-		size = std::fmaxf(4.0f, std::fminf(size + change, 256.0f));
-		for (uint8_t type = ROCK; type < types; ++type)
+		Simulation& controlled = getControlledSimulation();
+		float size = std::fmaxf(4.0f, std::fminf(controlled.getConfig().size + change, 256.0f));
+		controlled.setSize(size);
+		getControlledSettings().size = size;
+	}
+
+	void Engine::switchSteering()
+	{
+		Simulation& controlled = getControlledSimulation();
+		bool isFlowField = !controlled.getConfig().isFlowField;
+		controlled.setFlowField(isFlowField);
+		getControlledSettings().isFlowField = isFlowField;
+	}
+
+	void Engine::switchGovernor()
+	{
+		isGovernor = !isGovernor;
+		governor.setEnabled(isGovernor);
+		gameSettings.isGovernor = isGovernor;
+		applyQuality();
+	}
+
+	void Engine::applyQuality()
+	{
+		const QualityLevels& levels = governor.getLevels();
+		retargetInterval = levels.retargetInterval;
+		renderLOD = levels.renderLOD;
+		soundVoices = levels.soundVoices;
+		simulation.setRetargetInterval(retargetInterval);
+		for (auto& arena : arenas)
 		{
-			for (auto object : objects[type])
-			{
-				object->setSize(sf::Vector2f(size, size));
-				object->setOrigin(sf::Vector2f(size / 2.0f, size / 2.0f));
-			}
+			arena->simulation.setRetargetInterval(retargetInterval);
 		}
-		gameSettings.size = size;
+		mixer.setVoiceLimit(soundVoices);
 	}
 
 	void Engine::changeVolume(float change)
 	{
 		volume = std::fmaxf(0.0f, std::fminf(volume + change, 100.0f));
-		for (auto sound : soundPoll)
-		{
-			sound->setVolume(volume);
-		}
+		mixer.setMasterVolume(volume);
 		gameSettings.volume = volume;
 	}
 
 // --------------------------------Helpful Functions--------------------------------
 
-	inline sf::Vector2f Engine::getRandomPos()
+	// Shows the selected arena in multi-arena mode
+	void Engine::setF3MenuStats()
 	{
-		return sf::Vector2f(rand() % winSize.x, rand() % winSize.y);
+		const Simulation& controlled = getControlledSimulation();
+		F3Menu[1].setString(
+			std::to_string(FPSLimit)  + '\n' +
+			std::to_string(deltaTime) + '\n' +
+			'\n' +
+			std::to_string(controlled.getCount(ROCK)) + '\n' +
+			std::to_string(controlled.getCount(PAPER)) + '\n' +
+			std::to_string(controlled.getCount(SCISSORS)) + '\n' +
+			std::to_string(controlled.getCount(ROCK) + controlled.getCount(PAPER) + controlled.getCount(SCISSORS)) + '\n' +
+			'\n' +
+			std::to_string(static_cast<int64_t>(controlled.getConfig().speed)) + '\n' +
+			std::to_string(static_cast<int64_t>(controlled.getConfig().size))  + '\n' +
+			std::to_string(static_cast<int64_t>(volume)) + '\n' +
+			std::to_string(controlled.getConfig().count) + '\n' +
+			(controlled.getConfig().isFlowField ? "Flow Field" : "Exact") + '\n' +
+			getDistributionName(placement.distribution) + " x" + std::to_string(bulkCount) + '\n' +
+			std::to_string(controlled.getTick()) + '\n' +
+			(arenas.empty() ? std::string("-") : std::to_string(selectedArena + 1ull) + " / " + std::to_string(arenas.size())) + '\n' +
+			'\n' +
+			getConversionStats() +
+			'\n' +
+			(isGovernor ? "On (" : "Off (") + governor.getLastDecision() + ")\n" +
+			std::to_string(static_cast<int64_t>(governor.getAverageFrameTime() * 1000000.0f)) + " / " +
+			std::to_string(static_cast<int64_t>(governor.getTargetFrameTime() * 1000000.0f)) + " us\n" +
+			std::to_string(retargetInterval) + '\n' +
+			std::to_string(renderLOD) + '\n' +
+			std::to_string(mixer.getActiveVoices()) + " / " + std::to_string(soundVoices) + '\n' +
+			std::to_string(settings.antialiasingLevel) + '\n' +
+			std::to_string(jobs.getThreadCount()) + (jobs.isPinned() ? " (pinned)\n" : "\n") +
+			'\n' +
+			std::to_string(frameAllocTotal.allocations) + " / frame, " +
+			std::to_string(frameAllocTotal.bytes) + " B\n" +
+			"E " + std::to_string(frameAllocs[static_cast<size_t>(AllocPhase::Events)].allocations) +
+			" S " + std::to_string(frameAllocs[static_cast<size_t>(AllocPhase::Simulation)].allocations) +
+			" R " + std::to_string(frameAllocs[static_cast<size_t>(AllocPhase::Render)].allocations) +
+			" A " + std::to_string(frameAllocs[static_cast<size_t>(AllocPhase::Audio)].allocations) +
+			" O " + std::to_string(frameAllocs[static_cast<size_t>(AllocPhase::Other)].allocations)
+		);
 	}
 
-	sf::RectangleShape* Engine::createObject(sf::Vector2f pos, float size, uint8_t type)
+	// Counters are global, so allocations of the audio and consumer threads land in whichever frame they happen in
+	void Engine::updateAllocStats()
 	{
-		sf::RectangleShape* object = new sf::RectangleShape;
+		frameAllocTotal = AllocStats();
+		for (size_t phase = 0ull; phase < frameAllocs.size(); ++phase)
+		{
+			AllocStats total = AllocTracker::getStats(static_cast<AllocPhase>(phase));
+			frameAllocs[phase] = total - allocTotals[phase];
+			allocTotals[phase] = total;
+
+			frameAllocTotal.allocations += frameAllocs[phase].allocations;
+			frameAllocTotal.frees += frameAllocs[phase].frees;
+			frameAllocTotal.bytes += frameAllocs[phase].bytes;
+		}
+	}
 
-		object->setSize(sf::Vector2f(size, size));
-		object->setOrigin(sf::Vector2f(size / 2.0f, size / 2.0f));
-		object->setPosition(pos);
-		object->setTexture(textures[type]);
+	// Arenas do not publish to the conversion bus, so they show their own total and no bus figures
+	std::string Engine::getConversionStats() const
+	{
+		if (!arenas.empty())
+			return std::to_string(arenas[selectedArena]->conversions) + "\n-\n-\n";
+		return std::to_string(conversionCounts[ROCK].load()) + " / " +
+			std::to_string(conversionCounts[PAPER].load()) + " / " +
+			std::to_string(conversionCounts[SCISSORS].load()) + '\n' +
+			std::to_string(static_cast<int64_t>(conversionRate.load())) + " /s\n" +
+			std::to_string(audioConsumer->getDropped() + statsConsumer->getDropped() + logConsumer->getDropped()) + '\n';
+	}
 
-		return object;
+	inline void Engine::clearEventPoll()
+	{
+		while (window->pollEvent(event)) {};
 	}
 
-	void Engine::playSound(sf::SoundBuffer* soundBuffer)
+// --------------------------------Conversion Consumers--------------------------------
+
+	void Engine::startConsumers()
 	{
-		sf::Sound* sound = new sf::Sound;
-		sound->setBuffer(*soundBuffer);
-		if (soundPoll.size() < MAX_SIZE_SOUND_POLL)
+		for (auto& counter : conversionCounts)
 		{
-			sound->setVolume(volume);
-			sound->play();
-			soundPoll.push_back(sound);
+			counter.store(0ull);
 		}
-		else
+		conversionRate.store(0.0f);
+		statsWindowCount = 0ull;
+		statsWindowStart = std::chrono::steady_clock::now();
+		isConversionLog.store(false);
+
+		conversionBus.reset(new ConversionBus(CONVERSION_BUS_CAPACITY));
+		simulation.setConversionBus(conversionBus.get());
+
+		std::mt19937 random(rand());
+		audioConsumer.reset(new ConversionConsumer(*conversionBus, "Audio Consumer",
+			[this, random](const ConversionEvent& event) mutable
+			{
+				const std::vector<size_t>& clips = soundClips[event.hunterType];
+				if (clips.size() != 0ull)
+					mixer.trigger(clips[random() % clips.size()]);
+			}));
+
+		statsConsumer.reset(new ConversionConsumer(*conversionBus, "Stats Consumer",
+			[this](const ConversionEvent& event)
+			{
+				conversionCounts[event.hunterType].fetch_add(1ull, std::memory_order_relaxed);
+				++statsWindowCount;
+			},
+			[this]()
+			{
+				auto now = std::chrono::steady_clock::now();
+				float elapsed = std::chrono::duration<float>(now - statsWindowStart).count();
+				if (elapsed < 1.0f)
+					return;
+				conversionRate.store(statsWindowCount / elapsed, std::memory_order_relaxed);
+				statsWindowCount = 0ull;
+				statsWindowStart = now;
+			}));
+
+		logConsumer.reset(new ConversionConsumer(*conversionBus, "Log Consumer",
+			[this](const ConversionEvent& event)
+			{
+				if (!isConversionLog.load(std::memory_order_relaxed))
+					return;
+				std::cout << event.tick << '\t' << event.hunterId << '\t' << static_cast<int>(event.hunterType) << '\t'
+					<< event.victimId << '\t' << static_cast<int>(event.victimType) << '\t'
+					<< event.x << '\t' << event.y << '\n';
+			}));
+	}
+
+	void Engine::stopConsumers()
+	{
+		simulation.setConversionBus(nullptr);
+		audioConsumer.reset();
+		statsConsumer.reset();
+		logConsumer.reset();
+	}
+
+	void Engine::switchConversionLog()
+	{
+		isConversionLog.store(!isConversionLog.load());
+	}
+
+	inline void Engine::sleep(int64_t milliseconds)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+	}
+
+	void Engine::restart()
+	{
+		TRACE_SCOPE("restart");
+		if (!arenas.empty())
+		{
+			restartArenas();
+			return;
+		}
+		simulation.clear();
+		history.clear();
+		for (auto& counter : conversionCounts)
 		{
-			soundHeap.push_back(sound);
+			counter.store(0ull);
 		}
+
+		pendingObjects = std::async(std::launch::async, &Simulation::generateObjects, simulation.getConfig(), placement, simulation.getNextSeed(), &jobs);
+
+		clearEventPoll();
+		mixer.stopVoices();
+		if (introSound != nullptr)
+			introSound->stop();
+		playIntro();
 	}
 
-	void Engine::setF3MenuStats()
+// --------------------------------Snapshots--------------------------------
+
+	// The state is serialized on the main thread (one pass over the arrays) and written out on a worker.
+	// In multi-arena mode the selected arena is saved.
+	void Engine::saveSnapshot()
 	{
-		F3Menu[1].setString(
-			std::to_string(FPSLimit)  + '\n' +
-			std::to_string(deltaTime) + '\n' +
-			'\n' +
-			std::to_string(objects[0].size()) + '\n' +
-			std::to_string(objects[1].size()) + '\n' +
-			std::to_string(objects[2].size()) + '\n' +
-			std::to_string(objects[0].size() + objects[1].size() + objects[2].size()) + '\n' +
-			'\n' +
-			std::to_string(static_cast<int64_t>(speed))  + '\n' +
-			std::to_string(static_cast<int64_t>(size))   + '\n' +
-			std::to_string(static_cast<int64_t>(volume)) + '\n' +
-			std::to_string(count)
-		);
+		TRACE_SCOPE("saveSnapshot");
+		if (isIntro || (snapshotSave.valid() && snapshotSave.wait_for(std::chrono::seconds(0)) != std::future_status::ready))
+			return;
+
+		std::vector<char> buffer;
+		getControlledSimulation().saveSnapshot(buffer);
+		snapshotSave = std::async(std::launch::async, [buffer = std::move(buffer)]()
+		{
+			TRACE_SCOPE("writeSnapshot");
+			if (SnapshotFile::write(SNAPSHOT_FILE, buffer))
+				std::cout << "Snapshot was saved to " << SNAPSHOT_FILE << std::endl;
+		});
+	}
+
+	bool Engine::loadSnapshot(const std::string& fileName)
+	{
+		TRACE_SCOPE("loadSnapshot");
+		if (!arenas.empty())
+			return false;
+		if (snapshotSave.valid())
+			snapshotSave.wait();
+
+		SnapshotFile file;
+		if (!file.open(fileName))
+			return false;
+		if (file.getHeader().types != types)
+		{
+			std::cout << fileName << " has " << static_cast<int>(file.getHeader().types) << " types, expected " << static_cast<int>(types) << std::endl;
+			return false;
+		}
+		if (!simulation.loadSnapshot(file))
+		{
+			std::cout << "Failed to load " << fileName << std::endl;
+			return false;
+		}
+
+		if (pendingObjects.valid())
+			pendingObjects.get();
+		if (isIntro && introSound != nullptr)
+			introSound->stop();
+		isIntro = false;
+		history.clear();
+		mixer.stopVoices();
+
+		const SimulationConfig& loaded = simulation.getConfig();
+		gameSettings.count = loaded.count;
+		gameSettings.speed = loaded.speed;
+		gameSettings.size = loaded.size;
+		gameSettings.worldWidth = static_cast<unsigned int>(loaded.worldSize.x);
+		gameSettings.worldHeight = static_cast<unsigned int>(loaded.worldSize.y);
+		gameSettings.isFlowField = loaded.isFlowField;
+		gameSettings.flowCellSize = loaded.flowCellSize;
+		worldSize = loaded.worldSize;
+		resetCamera();
+
+		std::cout << fileName << " was loaded at tick " << simulation.getTick() << std::endl;
+		return true;
 	}
 
-	void Engine::cleanSoundPoll()
+// --------------------------------Camera--------------------------------
+
+	// Keeps the current zoom (world units per pixel) across window re-creation
+	void Engine::setCamera()
 	{
-		for (size_t i = 0ull; i < soundPoll.size(); ++i)
+		if (cameraZoom <= 0.0f)
 		{
-			if (soundPoll[i]->getStatus() == sf::Sound::Stopped)
+			resetCamera();
+			return;
+		}
+		camera.setSize(sf::Vector2f(winSize.x * cameraZoom, winSize.y * cameraZoom));
+	}
+
+	void Engine::resetCamera()
+	{
+		cameraZoom = std::fmaxf(worldSize.x / winSize.x, worldSize.y / winSize.y);
+		camera.setSize(sf::Vector2f(winSize.x * cameraZoom, winSize.y * cameraZoom));
+		camera.setCenter(worldSize / 2.0f);
+	}
+
+	void Engine::zoomCamera(float factor, sf::Vector2i pixel)
+	{
+		float maxZoom = 2.0f * std::fmaxf(worldSize.x / winSize.x, worldSize.y / winSize.y);
+		float newZoom = std::fmaxf(MIN_CAMERA_ZOOM, std::fminf(cameraZoom * factor, maxZoom));
+
+		sf::Vector2f anchor = window->mapPixelToCoords(pixel, camera);
+		camera.setSize(sf::Vector2f(winSize.x * newZoom, winSize.y * newZoom));
+		camera.setCenter(anchor + (camera.getCenter() - anchor) * (newZoom / cameraZoom));
+		cameraZoom = newZoom;
+	}
+
+	void Engine::panCamera(sf::Vector2f pixels)
+	{
+		sf::Vector2f center = camera.getCenter() + pixels * cameraZoom;
+		center.x = std::fmaxf(0.0f, std::fminf(center.x, worldSize.x));
+		center.y = std::fmaxf(0.0f, std::fminf(center.y, worldSize.y));
+		camera.setCenter(center);
+	}
+
+// --------------------------------Population History--------------------------------
+
+	// In arena mode the history follows the selected arena and starts over when the selection changes
+	void Engine::recordHistory(float tickTime)
+	{
+		const Simulation& controlled = getControlledSimulation();
+		float population[MAX_TYPES];
+		for (uint8_t type = ROCK; type < types; ++type)
+		{
+			population[type] = static_cast<float>(controlled.getCount(type));
+		}
+		history.record(controlled.getTick(), population, static_cast<float>(controlled.getTickConversions() / deltaTime), tickTime);
+	}
+
+	// Newest samples on the right; older ones come from coarser levels, so time is compressed to the left
+	void Engine::drawHistory()
+	{
+		sf::Vector2f graphSize(320.0f, 96.0f);
+		sf::Vector2f graphPos(winSize.x - graphSize.x - 8.0f, 8.0f);
+
+		size_t columns = 0ull;
+		for (size_t level = 0ull; level < history.getLevels(); ++level)
+		{
+			size_t firstAge = level == 0ull ? 0ull : history.getSampleCount(level - 1ull) / history.getFactor();
+			columns += history.getSampleCount(level) - std::min(firstAge, history.getSampleCount(level));
+		}
+
+		historyGraph.setPrimitiveType(sf::Triangles);
+		historyGraph.resize(6ull + (columns > 1ull ? (columns - 1ull) * types * 6ull : 0ull));
+
+		sf::Color background(0u, 0u, 0u, 160u);
+		historyGraph[0] = sf::Vertex(graphPos, background);
+		historyGraph[1] = sf::Vertex(sf::Vector2f(graphPos.x + graphSize.x, graphPos.y), background);
+		historyGraph[2] = sf::Vertex(graphPos + graphSize, background);
+		historyGraph[3] = historyGraph[0];
+		historyGraph[4] = historyGraph[2];
+		historyGraph[5] = sf::Vertex(sf::Vector2f(graphPos.x, graphPos.y + graphSize.y), background);
+
+		float step = columns > 1ull ? graphSize.x / (columns - 1ull) : 0.0f;
+		float previousTops[MAX_TYPES + 1u];
+		float previousX = 0.0f;
+		size_t column = 0ull;
+		size_t vertex = 6ull;
+		for (size_t level = 0ull; level < history.getLevels(); ++level)
+		{
+			size_t firstAge = level == 0ull ? 0ull : history.getSampleCount(level - 1ull) / history.getFactor();
+			for (size_t age = firstAge; age < history.getSampleCount(level); ++age, ++column)
+			{
+				const float* sample = history.getSample(level, age);
+				float total = 0.0f;
+				for (uint8_t type = ROCK; type < types; ++type)
+				{
+					total += sample[type];
+				}
+
+				float x = graphPos.x + graphSize.x - column * step;
+				float tops[MAX_TYPES + 1u];
+				tops[0] = graphPos.y + graphSize.y;
+				for (uint8_t type = ROCK; type < types; ++type)
+				{
+					float share = total > 0.0f ? sample[type] / total : 0.0f;
+					tops[type + 1u] = tops[type] - share * graphSize.y;
+				}
+
+				if (column != 0ull)
+				{
+					for (uint8_t type = ROCK; type < types; ++type)
+					{
+						sf::Color color = typeColors[type];
+						historyGraph[vertex++] = sf::Vertex(sf::Vector2f(previousX, previousTops[type]), color);
+						historyGraph[vertex++] = sf::Vertex(sf::Vector2f(previousX, previousTops[type + 1u]), color);
+						historyGraph[vertex++] = sf::Vertex(sf::Vector2f(x, tops[type + 1u]), color);
+						historyGraph[vertex++] = sf::Vertex(sf::Vector2f(previousX, previousTops[type]), color);
+						historyGraph[vertex++] = sf::Vertex(sf::Vector2f(x, tops[type + 1u]), color);
+						historyGraph[vertex++] = sf::Vertex(sf::Vector2f(x, tops[type]), color);
+					}
+				}
+				std::copy(tops, tops + types + 1u, previousTops);
+				previousX = x;
+			}
+		}
+		window->draw(historyGraph);
+	}
+
+	// The history is copied (a fixed, small block) and written out on a worker, so the simulation keeps running
+	void Engine::dumpHistory()
+	{
+		TRACE_SCOPE("dumpHistory");
+		if (historyDump.valid() && historyDump.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return;
+
+		std::string fileName = "population_" + std::to_string(std::time(nullptr)) + ".csv";
+		historyDump = std::async(std::launch::async, [snapshot = history, fileName]()
+		{
+			TRACE_SCOPE("writeCSV");
+			std::ofstream file(fileName);
+			if (!file)
 			{
-				delete soundPoll[i];
-				soundPoll.erase(soundPoll.begin() + i);
+				std::cout << "Failed to write " << fileName << std::endl;
+				return;
 			}
+			snapshot.writeCSV(file);
+			std::cout << "Population history was saved to " << fileName << std::endl;
+		});
+	}
+
+// --------------------------------Arenas--------------------------------
+
+	// Every arena starts from the game's settings, with speed and size varied across them
+	void Engine::setArenas()
+	{
+		TRACE_SCOPE("setArenas");
+		size_t count = arenaConfig.arenas;
+		arenas.clear();
+		for (size_t i = 0ull; i < count; ++i)
+		{
+			std::unique_ptr<Arena> arena(new Arena);
+			arena->settings = gameSettings;
+			arena->settings.speed *= getSpreadFactor(i, count, arenaConfig.speedSpread);
+			arena->settings.size = std::fmaxf(4.0f, arena->settings.size * getSpreadFactor(i, count, arenaConfig.sizeSpread));
+			arenas.push_back(std::move(arena));
 		}
-		for (size_t i = 0ull; i < std::min(soundHeap.size(), MAX_SIZE_SOUND_POLL - soundPoll.size()); ++i)
+
+		arenaGrid.x = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(count))));
+		arenaGrid.y = static_cast<unsigned int>((count + arenaGrid.x - 1ull) / arenaGrid.x);
+		arenaFrames.setPrimitiveType(sf::Lines);
+		arenaFrames.resize(count * 8ull);
+
+		arenaLabels.assign(count, sf::Text());
+		for (auto& label : arenaLabels)
 		{
-			sf::Sound* temp = soundHeap.front(); 
-			temp->setVolume(volume);
-			temp->play();
-			soundPoll.push_back(temp);
-			soundHeap.erase(soundHeap.begin());
+			label.setFont(font);
+			label.setCharacterSize(CHAR_SIZE * 3u / 4u);
+			label.setFillColor(sf::Color(234u, 234u, 234u));
+			label.setOutlineThickness(1.0f);
+			label.setOutlineColor(sf::Color::Black);
 		}
+
+		std::cout << "Hosting " << count << " arenas on " << jobs.getThreadCount() << " threads" << std::endl;
+		restartArenas();
 	}
 
-	void Engine::clearSoundPoll()
+	// Arenas are generated side by side on the job system, each with a seed of its own unless they share one
+	void Engine::restartArenas()
 	{
-		for (auto sound : soundPoll)
+		TRACE_SCOPE("restartArenas");
+		history.clear();
+		uint32_t seed = static_cast<uint32_t>(rand());
+		for (size_t i = 0ull; i < arenas.size(); ++i)
 		{
-			delete sound;
+			arenas[i]->seed = arenaConfig.isSameSeed ? seed : seed + static_cast<uint32_t>(i);
 		}
-		soundPoll.clear();
+
+		jobs.parallelFor(arenas.size(), 1ull, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; ++i)
+			{
+				Arena& arena = *arenas[i];
+				arena.simulation.configure(getSimulationConfig(arena.settings), arena.seed);
+				arena.simulation.setJobSystem(&jobs);
+				arena.simulation.setRetargetInterval(retargetInterval);
+				arena.simulation.insertObjects(Simulation::generateObjects(arena.simulation.getConfig(), placement, arena.simulation.getNextSeed(), &jobs));
+				arena.conversions = 0ull;
+			}
+		});
 	}
 
-	void Engine::clearSoundHeap()
+	void Engine::stepArenas(float timeStep)
 	{
-		for (auto sound : soundHeap)
+		jobs.parallelFor(arenas.size(), 1ull, [&](size_t first, size_t last)
 		{
-			delete sound;
+			ALLOC_PHASE(Simulation);
+			for (size_t i = first; i < last; ++i)
+			{
+				Arena& arena = *arenas[i];
+				auto tickStartTime = std::chrono::steady_clock::now();
+				arena.simulation.step(timeStep);
+				arena.conversions += arena.simulation.getTickConversions();
+				arena.tickTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - tickStartTime).count();
+			}
+		});
+	}
+
+	// Tiles split the window evenly and each world is scaled to fit its tile
+	void Engine::layoutArenas()
+	{
+		sf::Vector2f tileSize(static_cast<float>(winSize.x) / arenaGrid.x, static_cast<float>(winSize.y) / arenaGrid.y);
+		for (size_t i = 0ull; i < arenas.size(); ++i)
+		{
+			Arena& arena = *arenas[i];
+			sf::Vector2f world = arena.simulation.getConfig().worldSize;
+			arena.tile = sf::FloatRect((i % arenaGrid.x) * tileSize.x, (i / arenaGrid.x) * tileSize.y, tileSize.x, tileSize.y);
+			arena.scale = std::fmaxf(0.0f, std::fminf((tileSize.x - 2.0f * ARENA_MARGIN) / world.x, (tileSize.y - 2.0f * ARENA_MARGIN) / world.y));
+			arena.origin = sf::Vector2f(arena.tile.left + (tileSize.x - world.x * arena.scale) / 2.0f, arena.tile.top + (tileSize.y - world.y * arena.scale) / 2.0f);
+
+			sf::Color color = i == selectedArena ? sf::Color::Yellow : sf::Color(96u, 96u, 96u);
+			sf::Vector2f corners[4] = {
+				arena.origin,
+				arena.origin + sf::Vector2f(world.x * arena.scale, 0.0f),
+				arena.origin + world * arena.scale,
+				arena.origin + sf::Vector2f(0.0f, world.y * arena.scale)
+			};
+			for (size_t edge = 0ull; edge < 4ull; ++edge)
+			{
+				arenaFrames[i * 8ull + edge * 2ull] = sf::Vertex(corners[edge], color);
+				arenaFrames[i * 8ull + edge * 2ull + 1ull] = sf::Vertex(corners[(edge + 1ull) % 4ull], color);
+			}
+			arenaLabels[i].setPosition(arena.origin + sf::Vector2f(ARENA_MARGIN, ARENA_MARGIN));
 		}
-		soundHeap.clear();
 	}
 
-	inline void Engine::clearEventPoll()
+	void Engine::setArenaLabels()
 	{
-		while (window->pollEvent(event)) {};
+		for (size_t i = 0ull; i < arenas.size(); ++i)
+		{
+			const Arena& arena = *arenas[i];
+			const Simulation& arenaSimulation = arena.simulation;
+			arenaLabels[i].setString(
+				'#' + std::to_string(i + 1ull) + " Seed " + std::to_string(arena.seed) + '\n' +
+				std::to_string(static_cast<int64_t>(arenaSimulation.getConfig().speed)) + " / " +
+				std::to_string(static_cast<int64_t>(arenaSimulation.getConfig().size)) + ' ' +
+				(arenaSimulation.getConfig().isFlowField ? "Flow Field" : "Exact") + '\n' +
+				std::to_string(arenaSimulation.getCount(ROCK)) + " / " +
+				std::to_string(arenaSimulation.getCount(PAPER)) + " / " +
+				std::to_string(arenaSimulation.getCount(SCISSORS)) + '\n' +
+				std::to_string(arenaSimulation.getTick()) + " ticks, " + std::to_string(arena.conversions) + " conv\n" +
+				std::to_string(static_cast<int64_t>(arena.tickTime * 1000000.0f)) + " us"
+			);
+		}
 	}
 
-// --------------------------------Useful Functions--------------------------------
+	void Engine::selectArena(int dx, int dy)
+	{
+		int x = static_cast<int>(selectedArena % arenaGrid.x) + dx;
+		int y = static_cast<int>(selectedArena / arenaGrid.x) + dy;
+		if (x < 0 || y < 0 || x >= static_cast<int>(arenaGrid.x) || y >= static_cast<int>(arenaGrid.y))
+			return;
+		size_t arena = static_cast<size_t>(y) * arenaGrid.x + x;
+		if (arena < arenas.size() && arena != selectedArena)
+		{
+			selectedArena = arena;
+			history.clear();
+		}
+	}
 
-	sf::Vector2f getNormalized(const sf::Vector2f& v)
+	void Engine::selectArenaAt(sf::Vector2i pixel)
 	{
-		float mag = std::sqrtf(v.x * v.x + v.y * v.y);
-		return sf::Vector2f(v.x / mag, v.y / mag);
+		for (size_t i = 0ull; i < arenas.size(); ++i)
+		{
+			if (arenas[i]->tile.contains(sf::Vector2f(pixel)) && i != selectedArena)
+			{
+				selectedArena = i;
+				history.clear();
+			}
+		}
 	}
 
-	inline sf::Vector2f getScaled(const sf::Vector2f& v, float scale)
+	Simulation& Engine::getControlledSimulation()
 	{
-		return sf::Vector2f(v.x * scale, v.y * scale);
+		return arenas.empty() ? simulation : arenas[selectedArena]->simulation;
 	}
 
-	inline sf::Vector2f getDistance(const sf::Vector2f& a, const sf::Vector2f& b)
+	GameSettings& Engine::getControlledSettings()
 	{
-		return sf::Vector2f(b.x - a.x, b.y - a.y);
+		return arenas.empty() ? gameSettings : arenas[selectedArena]->settings;
 	}
 
-	inline float getMagnitude(const sf::Vector2f& v)
+// --------------------------------Rendering--------------------------------
+
+	// Two triangles covering the whole texture, centered on the position
+	inline void setQuad(sf::Vertex* quad, const sf::Vector2f& pos, float halfSize, const sf::Vector2f& texSize)
 	{
-		return std::sqrtf(v.x * v.x + v.y * v.y);
+		quad[0] = sf::Vertex(sf::Vector2f(pos.x - halfSize, pos.y - halfSize), sf::Vector2f(0.0f, 0.0f));
+		quad[1] = sf::Vertex(sf::Vector2f(pos.x + halfSize, pos.y - halfSize), sf::Vector2f(texSize.x, 0.0f));
+		quad[2] = sf::Vertex(sf::Vector2f(pos.x + halfSize, pos.y + halfSize), texSize);
+		quad[3] = quad[0];
+		quad[4] = quad[2];
+		quad[5] = sf::Vertex(sf::Vector2f(pos.x - halfSize, pos.y + halfSize), sf::Vector2f(0.0f, texSize.y));
 	}
 
-	inline float getSqrMagnitude(const sf::Vector2f& v)
+	// Grids are rebuilt only when the simulation drops or reorders objects, or once objects may have moved
+	// further than RENDER_GRID_DRIFT since the last build; until then lookups are widened by that distance.
+	// Objects appended since the build are not in the grids and are walked on their own.
+	void Engine::updateRenderGrids()
 	{
-		return v.x * v.x + v.y * v.y;
+		const SimulationConfig& simulationConfig = simulation.getConfig();
+		if (simulation.getTick() > renderGridTick)
+		{
+			// Full speed toward a victim plus half speed away from a hunter
+			renderGridDrift += std::fabs(simulationConfig.speed) * 1.5f * static_cast<float>(simulationStep) * (simulation.getTick() - renderGridTick);
+			renderGridTick = simulation.getTick();
+		}
+		if (simulation.getLayoutVersion() == renderGridLayout && simulationConfig.size == renderGridSize && renderGridDrift <= RENDER_GRID_DRIFT)
+			return;
+
+		jobs.parallelFor(types, 1ull, [&](size_t firstType, size_t lastType)
+		{
+			for (size_t type = firstType; type < lastType; ++type)
+			{
+				renderGrids[type].resize(worldSize, RENDER_CELL_SIZE);
+				renderGrids[type].build(simulation.getPositions(static_cast<uint8_t>(type)), simulation.getAliveFlags(static_cast<uint8_t>(type)));
+				renderGridObjects[type] = simulation.getPositions(static_cast<uint8_t>(type)).size();
+			}
+		});
+		renderGridLayout = simulation.getLayoutVersion();
+		renderGridTick = simulation.getTick();
+		renderGridSize = simulationConfig.size;
+		renderGridDrift = 0.0f;
 	}
 
-	size_t Engine::getNearestObject(const sf::Vector2f& myPos, std::vector<sf::RectangleShape*>& victims)
+	// Only the grid cells under the camera are walked
+	void Engine::drawObjects()
 	{
-		size_t nearestVictim = 0ull;
-		float nearestDistSqrMag = getSqrMagnitude(getDistance(myPos, victims[0]->getPosition()));
-		for (size_t i = 0ull; i < victims.size(); ++i)
+		window->setView(camera);
+		updateRenderGrids();
+
+		float size = simulation.getConfig().size;
+		float halfSize = size / 2.0f;
+		sf::Vector2f viewSize = camera.getSize();
+		sf::FloatRect viewArea(camera.getCenter() - viewSize / 2.0f - sf::Vector2f(halfSize, halfSize), viewSize + sf::Vector2f(size, size));
+
+		if (renderLOD == 0u)
 		{
-			float distSqrMag = getSqrMagnitude(getDistance(myPos, victims[i]->getPosition()));
-			if (distSqrMag < nearestDistSqrMag)
+			objectShape.setSize(sf::Vector2f(size, size));
+			objectShape.setOrigin(sf::Vector2f(halfSize, halfSize));
+			for (uint8_t type = ROCK; type < types; ++type)
 			{
-				nearestVictim = i;
-				nearestDistSqrMag = distSqrMag;
+				const std::vector<sf::Vector2f>& positions = simulation.getPositions(type);
+				objectShape.setTexture(textures[type], true);
+				auto drawObject = [&](uint32_t object)
+				{
+					if (!simulation.isAlive(type, object) || !viewArea.contains(positions[object]))
+						return;
+					objectShape.setPosition(positions[object]);
+					window->draw(objectShape);
+				};
+				renderGrids[type].forEachInArea(getRenderGridArea(viewArea), drawObject);
+				for (size_t object = renderGridObjects[type]; object < positions.size(); ++object)
+				{
+					drawObject(static_cast<uint32_t>(object));
+				}
 			}
 		}
-		return nearestVictim;
+		else if (renderLOD == 1u)
+		{
+			for (uint8_t type = ROCK; type < types; ++type)
+			{
+				size_t vertices = buildObjectVertices(type, viewArea, 0ull);
+				if (vertices != 0ull)
+					window->draw(&objectBatch[0], vertices, sf::Triangles, sf::RenderStates(textures[type]));
+			}
+		}
+		else
+		{
+			size_t vertices = 0ull;
+			for (uint8_t type = ROCK; type < types; ++type)
+			{
+				vertices = buildObjectVertices(type, viewArea, vertices);
+			}
+			if (vertices != 0ull)
+				window->draw(&objectBatch[0], vertices, sf::Points);
+		}
+
+		window->setView(window->getDefaultView());
 	}
 
-	inline void Engine::moveTo(sf::RectangleShape* object, const sf::Vector2f& pos, float speed)
+	sf::FloatRect Engine::getRenderGridArea(const sf::FloatRect& viewArea) const
 	{
-		object->move(getScaled(getNormalized(getDistance(object->getPosition(), pos)), speed * deltaTime));
+		return sf::FloatRect(viewArea.left - renderGridDrift, viewArea.top - renderGridDrift, viewArea.width + renderGridDrift * 2.0f, viewArea.height + renderGridDrift * 2.0f);
 	}
 
-	inline void Engine::sleep(int64_t milliseconds)
+	// Every row of grid cells under the view gets a slice of the batch with room for all of its objects,
+	// and objects appended since the grids were built get one more slice. The slices are filled
+	// on the job system and then packed together. The batch only ever grows,
+	// so the vertex count to draw is returned rather than stored in it.
+	size_t Engine::buildObjectVertices(uint8_t type, const sf::FloatRect& viewArea, size_t firstVertex)
 	{
-		std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+		const SpatialGrid& grid = renderGrids[type];
+		const std::vector<sf::Vector2f>& positions = simulation.getPositions(type);
+		size_t objectVertices = renderLOD == 1u ? 6ull : 1ull;
+		float halfSize = simulation.getConfig().size / 2.0f;
+		sf::Vector2f texSize(textures[type]->getSize());
+		sf::Color color = typeColors[type];
+
+		sf::FloatRect gridArea = getRenderGridArea(viewArea);
+		sf::Vector2i first = grid.getCellCoords(sf::Vector2f(gridArea.left, gridArea.top));
+		sf::Vector2i last = grid.getCellCoords(sf::Vector2f(gridArea.left + gridArea.width, gridArea.top + gridArea.height));
+		size_t rows = static_cast<size_t>(last.y - first.y) + 1ull;
+		size_t appended = positions.size() - renderGridObjects[type];
+		batchSliceStarts.resize(rows + 2ull);
+		batchSliceSizes.resize(rows + 1ull);
+		batchSliceStarts[0] = firstVertex;
+		for (size_t row = 0ull; row < rows; ++row)
+		{
+			batchSliceStarts[row + 1ull] = batchSliceStarts[row] + grid.getRowObjectCount(first.y + static_cast<int>(row), first.x, last.x) * objectVertices;
+		}
+		batchSliceStarts[rows + 1ull] = batchSliceStarts[rows] + appended * objectVertices;
+		if (objectBatch.getVertexCount() < batchSliceStarts[rows + 1ull])
+			objectBatch.resize(batchSliceStarts[rows + 1ull]);
+
+		jobs.parallelFor(rows + 1ull, 1ull, [&](size_t firstRow, size_t lastRow)
+		{
+			for (size_t row = firstRow; row < lastRow; ++row)
+			{
+				size_t vertex = batchSliceStarts[row];
+				auto addObject = [&](uint32_t object)
+				{
+					sf::Vector2f pos = positions[object];
+					if (!simulation.isAlive(type, object) || !viewArea.contains(pos))
+						return;
+					if (objectVertices == 1ull)
+						objectBatch[vertex] = sf::Vertex(pos, color);
+					else
+						setQuad(&objectBatch[vertex], pos, halfSize, texSize);
+					vertex += objectVertices;
+				};
+				if (row < rows)
+				{
+					grid.forEachInRow(first.y + static_cast<int>(row), first.x, last.x, addObject);
+				}
+				else
+				{
+					for (size_t object = renderGridObjects[type]; object < positions.size(); ++object)
+					{
+						addObject(static_cast<uint32_t>(object));
+					}
+				}
+				batchSliceSizes[row] = vertex - batchSliceStarts[row];
+			}
+		});
+
+		return packBatchSlices(rows + 1ull);
 	}
 
-	void Engine::restart()
+	// Every arena goes into the same batch, already moved into its tile, so the number of draw calls
+	// does not grow with the number of arenas. Tiles are too small for one draw per object, so LOD 0 draws as LOD 1.
+	void Engine::drawArenas()
 	{
-		for (uint8_t type = ROCK; type < types; ++type)
+		layoutArenas();
+		if (renderLOD < 2u)
+		{
+			for (uint8_t type = ROCK; type < types; ++type)
+			{
+				size_t vertices = buildArenaVertices(type, 0ull);
+				if (vertices != 0ull)
+					window->draw(&objectBatch[0], vertices, sf::Triangles, sf::RenderStates(textures[type]));
+			}
+		}
+		else
 		{
-			for (auto object : objects[type])
+			size_t vertices = 0ull;
+			for (uint8_t type = ROCK; type < types; ++type)
 			{
-				delete object;
+				vertices = buildArenaVertices(type, vertices);
 			}
-			objects[type].clear();
+			if (vertices != 0ull)
+				window->draw(&objectBatch[0], vertices, sf::Points);
+		}
+		window->draw(arenaFrames);
+	}
+
+	// One slice of the batch per arena, filled on the job system
+	size_t Engine::buildArenaVertices(uint8_t type, size_t firstVertex)
+	{
+		size_t objectVertices = renderLOD < 2u ? 6ull : 1ull;
+		sf::Vector2f texSize(textures[type]->getSize());
+		sf::Color color = typeColors[type];
+
+		batchSliceStarts.resize(arenas.size() + 1ull);
+		batchSliceSizes.resize(arenas.size());
+		batchSliceStarts[0] = firstVertex;
+		for (size_t i = 0ull; i < arenas.size(); ++i)
+		{
+			batchSliceStarts[i + 1ull] = batchSliceStarts[i] + arenas[i]->simulation.getPositions(type).size() * objectVertices;
+		}
+		if (objectBatch.getVertexCount() < batchSliceStarts[arenas.size()])
+			objectBatch.resize(batchSliceStarts[arenas.size()]);
 
-			for (size_t i = 0ull; i < count; ++i)
+		jobs.parallelFor(arenas.size(), 1ull, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; ++i)
 			{
-				sf::RectangleShape* object = createObject(getRandomPos(), size, type);
-				objects[type].push_back(object);
+				const Arena& arena = *arenas[i];
+				const std::vector<sf::Vector2f>& positions = arena.simulation.getPositions(type);
+				float halfSize = arena.simulation.getConfig().size * arena.scale / 2.0f;
+				size_t vertex = batchSliceStarts[i];
+				for (size_t object = 0ull; object < positions.size(); ++object)
+				{
+					if (!arena.simulation.isAlive(type, object))
+						continue;
+					sf::Vector2f pos = arena.origin + positions[object] * arena.scale;
+					if (objectVertices == 1ull)
+						objectBatch[vertex] = sf::Vertex(pos, color);
+					else
+						setQuad(&objectBatch[vertex], pos, halfSize, texSize);
+					vertex += objectVertices;
+				}
+				batchSliceSizes[i] = vertex - batchSliceStarts[i];
 			}
+		});
+		return packBatchSlices(arenas.size());
+	}
+
+	// Slices are filled up to their sizes and may hold gaps; moves them together behind the first one
+	size_t Engine::packBatchSlices(size_t slices)
+	{
+		size_t vertices = batchSliceStarts[0];
+		for (size_t slice = 0ull; slice < slices; ++slice)
+		{
+			if (batchSliceSizes[slice] != 0ull && batchSliceStarts[slice] != vertices)
+				std::copy(&objectBatch[batchSliceStarts[slice]], &objectBatch[batchSliceStarts[slice]] + batchSliceSizes[slice], &objectBatch[vertices]);
+			vertices += batchSliceSizes[slice];
 		}
-		clearEventPoll();
-		clearSoundPoll();
-		clearSoundHeap();
-		playIntro();
+		return vertices;
 	}
 
 	void Engine::debugLog(size_t n, ...)
@@ -632,7 +1483,10 @@ namespace rps
 		while (window->isOpen())
 		{
 			startFrameTime = timer.now();
+			TRACE_BEGIN("Frame");
 
+			TRACE_BEGIN("Events");
+			AllocTracker::setPhase(AllocPhase::Events);
 			while (window->pollEvent(event))
 			{
 				switch (event.type)
@@ -647,22 +1501,54 @@ namespace rps
 					setFullscreen();
 					break;
 				}
+				case sf::Event::MouseWheelScrolled:
+				{
+					if (!arenas.empty())
+						break;
+					zoomCamera(event.mouseWheelScroll.delta > 0.0f ? 0.8f : 1.25f, sf::Vector2i(event.mouseWheelScroll.x, event.mouseWheelScroll.y));
+					break;
+				}
+				case sf::Event::MouseButtonPressed:
+				{
+					if (!arenas.empty())
+					{
+						selectArenaAt(sf::Vector2i(event.mouseButton.x, event.mouseButton.y));
+						break;
+					}
+					isCameraDrag = true;
+					cameraDragPos = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
+					break;
+				}
+				case sf::Event::MouseButtonReleased:
+				{
+					isCameraDrag = false;
+					break;
+				}
+				case sf::Event::MouseMoved:
+				{
+					if (!isCameraDrag)
+						break;
+					sf::Vector2i mousePos(event.mouseMove.x, event.mouseMove.y);
+					panCamera(sf::Vector2f(cameraDragPos - mousePos));
+					cameraDragPos = mousePos;
+					break;
+				}
 				case sf::Event::KeyPressed:
 				{
 					switch (event.key.code)
 					{
 					case sf::Keyboard::Num1:
-						addObject(ROCK); break;
+						spawnObjects(ROCK, event.key.shift); break;
 					case sf::Keyboard::Num2:
-						addObject(PAPER); break;
+						spawnObjects(PAPER, event.key.shift); break;
 					case sf::Keyboard::Num3:
-						addObject(SCISSORS); break;
+						spawnObjects(SCISSORS, event.key.shift); break;
 					case sf::Keyboard::Num4:
-						deleteObject(ROCK); break;
+						despawnObjects(ROCK, event.key.shift); break;
 					case sf::Keyboard::Num5:
-						deleteObject(PAPER); break;
+						despawnObjects(PAPER, event.key.shift); break;
 					case sf::Keyboard::Num6:
-						deleteObject(SCISSORS); break;
+						despawnObjects(SCISSORS, event.key.shift); break;
 					case sf::Keyboard::Q:
 						changeSpeed(4.0f); break;
 					case sf::Keyboard::A:
@@ -676,9 +1562,35 @@ namespace rps
 					case sf::Keyboard::D:
 						changeVolume(-2.0f); break;
 					case sf::Keyboard::X:
-						changeCount(1ll); break;
+						changeCount(event.key.shift ? static_cast<int64_t>(bulkCount) : 1ll); break;
+					case sf::Keyboard::Left:
+						if (arenas.empty())
+							panCamera(sf::Vector2f(-32.0f, 0.0f));
+						else
+							selectArena(-1, 0);
+						break;
+					case sf::Keyboard::Right:
+						if (arenas.empty())
+							panCamera(sf::Vector2f(32.0f, 0.0f));
+						else
+							selectArena(1, 0);
+						break;
+					case sf::Keyboard::Up:
+						if (arenas.empty())
+							panCamera(sf::Vector2f(0.0f, -32.0f));
+						else
+							selectArena(0, -1);
+						break;
+					case sf::Keyboard::Down:
+						if (arenas.empty())
+							panCamera(sf::Vector2f(0.0f, 32.0f));
+						else
+							selectArena(0, 1);
+						break;
+					case sf::Keyboard::Home:
+						resetCamera(); break;
 					case sf::Keyboard::Z:
-						changeCount(-1ll); break;
+						changeCount(event.key.shift ? -static_cast<int64_t>(bulkCount) : -1ll); break;
 					}
 
 					break;
@@ -693,8 +1605,32 @@ namespace rps
 						isF3Menu = !isF3Menu; break;
 					case sf::Keyboard::R:
 						restart(); break;
+					case sf::Keyboard::Tab:
+						if (isIntro)
+						{
+							if (introSound != nullptr)
+								introSound->stop();
+							finishIntro();
+						}
+						break;
 					case sf::Keyboard::C:
 						isControlsTab = !isControlsTab; break;
+					case sf::Keyboard::F:
+						switchSteering(); break;
+					case sf::Keyboard::G:
+						switchGovernor(); break;
+					case sf::Keyboard::V:
+						switchDistribution(); break;
+					case sf::Keyboard::L:
+						switchConversionLog(); break;
+					case sf::Keyboard::H:
+						isHistoryGraph = !isHistoryGraph; break;
+					case sf::Keyboard::P:
+						dumpHistory(); break;
+					case sf::Keyboard::F5:
+						saveSnapshot(); break;
+					case sf::Keyboard::F9:
+						loadSnapshot(SNAPSHOT_FILE); break;
 					case sf::Keyboard::F11:
 						isFullscreen = !isFullscreen;
 						setFullscreen();
@@ -705,72 +1641,68 @@ namespace rps
 				}
 				}
 			}
+			TRACE_END("Events");
 
-			for (uint8_t type = ROCK; type < types; ++type)
+			if (isIntro)
 			{
-				uint8_t victimType = (type + types - 1u) % types;
-				uint8_t hunterType = (type + 1u) % types;
-
-				for (size_t i = 0ull; i < objects[type].size(); ++i)
-				{
-					sf::RectangleShape* object = objects[type][i];
-					if (objects[victimType].size() != 0ull)
-					{
-						size_t nearestVictimIndex = getNearestObject(object->getPosition(), objects[victimType]);
-						sf::RectangleShape* nearestVictim = objects[victimType][nearestVictimIndex];
-						moveTo(object, nearestVictim->getPosition(), speed);
-
-						if (object->getGlobalBounds().contains(nearestVictim->getPosition()))
-						{
-							objects[victimType].erase(objects[victimType].cbegin() + nearestVictimIndex);
-							objects[type].push_back(nearestVictim);
-							//std::cout << i << '\t' << static_cast<int>(victimType) << '\t' << objects[victimType].size() << '\t' << static_cast<int>(type) << '\t' << objects[type].size() << '\t' << static_cast<int>(hunterType) << '\t' << objects[hunterType].size() << std::endl;
-							objects[type].back()->setTexture(textures[type]);
-
-							if (soundBuffers[type].size() != 0ull)
-								playSound(soundBuffers[type][rand() % soundBuffers[type].size()]);
-
-						}
-					}
-					if (objects[hunterType].size() != 0ull)
-					{
-						size_t nearestHunterIndex = getNearestObject(object->getPosition(), objects[hunterType]);
-						sf::RectangleShape* nearestHunter = objects[hunterType][nearestHunterIndex];
-						moveTo(object, nearestHunter->getPosition(), -speed * 0.5f);
-					}
-					sf::Vector2f myPos = object->getPosition();
-					float x = std::fmax(std::fmin(myPos.x, static_cast<float>(winSize.x) - size), size);
-					float y = std::fmax(std::fmin(myPos.y, static_cast<float>(winSize.y) - size), size);
-					object->setPosition(sf::Vector2f(x, y));
-				}
+				updateIntro();
+			}
+			else if (!arenas.empty())
+			{
+				TRACE_SCOPE("Arenas");
+				ALLOC_PHASE(Simulation);
+				stepArenas(static_cast<float>(simulationStep));
+				recordHistory(arenas[selectedArena]->tickTime);
+			}
+			else
+			{
+				TRACE_SCOPE("Simulation");
+				ALLOC_PHASE(Simulation);
+				auto tickStartTime = timer.now();
+				simulation.step(static_cast<float>(simulationStep));
+				recordHistory(std::chrono::duration_cast<std::chrono::duration<float>>(timer.now() - tickStartTime).count());
 			}
 
+			TRACE_BEGIN("Render");
+			AllocTracker::setPhase(AllocPhase::Render);
 			window->clear();
 
-			for (uint8_t type = ROCK; type < types; ++type)
-			{
-				for (auto object : objects[type])
-				{
-					window->draw(*object);
-				}
-			}
-			debugLog(2ull, objects[ROCK][0]->getPosition().x, objects[ROCK][0]->getPosition().y);
+			if (isIntro)
+				window->draw(introPreview);
+			else if (!arenas.empty())
+				drawArenas();
+			else
+				drawObjects();
+			if (simulation.getPositions(ROCK).size() != 0ull)
+				debugLog(2ull, simulation.getPositions(ROCK)[0].x, simulation.getPositions(ROCK)[0].y);
 
 			if (isF3Menu)
 			{
 				setF3MenuStats();
 
-				for (auto panel : F3Menu)
+				for (const auto& panel : F3Menu)
 				{
 					window->draw(panel);
 				}
+
+				if (!arenas.empty())
+				{
+					setArenaLabels();
+					for (const auto& label : arenaLabels)
+					{
+						window->draw(label);
+					}
+				}
 			}
 
 			window->draw(debugString);
 
+			if (isHistoryGraph)
+				drawHistory();
+
 			if (isControlsTab)
 			{
-				for (auto panel : controlsTab)
+				for (const auto& panel : controlsTab)
 				{
 					window->draw(panel);
 				}
@@ -782,18 +1714,34 @@ namespace rps
 				timeCounter = std::fmodl(timeCounter, 1.0l);
 			}
 			window->draw(FPSCounter);
+			TRACE_END("Render");
 
+			TRACE_BEGIN("Display");
 			window->display();
-
-			cleanSoundPoll();
+			TRACE_END("Display");
+			AllocTracker::setPhase(AllocPhase::Other);
 
 			deltaTime = std::chrono::duration_cast<std::chrono::duration<long double>>(timer.now() - startFrameTime).count();
+			long double frameTime = deltaTime;
 			if (1.0 / FPSLimit >= deltaTime)
 			{
+				TRACE_SCOPE("Sleep");
 				deltaTime = 1.0 / FPSLimit;
 				sleep(static_cast<int64_t>(deltaTime * 1000.0));
 			}
 			timeCounter += deltaTime;
+
+			if (governor.update(static_cast<float>(frameTime), static_cast<float>(deltaTime)))
+				applyQuality();
+			simulationStep = governor.getSimulationStep(static_cast<float>(deltaTime));
+
+			TRACE_COUNTER("Rocks", simulation.getCount(ROCK));
+			TRACE_COUNTER("Papers", simulation.getCount(PAPER));
+			TRACE_COUNTER("Scissors", simulation.getCount(SCISSORS));
+			updateAllocStats();
+			TRACE_COUNTER("Frame Time (ms)", frameTime * 1000.0l);
+			TRACE_COUNTER("Allocations", frameAllocTotal.allocations);
+			TRACE_END("Frame");
 		}
 	}
 }
\ No newline at end of file
@@ -3,16 +3,41 @@
 #include <SFML/Audio.hpp>
 #include <Windows.h>
 #include <iostream>
+#include <fstream>
+#include <ctime>
+
+#include "Simulation.hpp"
+#include "FlowField.hpp"
+#include "QualityGovernor.hpp"
+#include "ConversionBus.hpp"
+#include "PopulationHistory.hpp"
+#include "Tracer.hpp"
+#include "SoundMixer.hpp"
+#include "AllocTracker.hpp"
+#include "JobSystem.hpp"
+#include "ForkRunner.hpp"
 
 #include <thread>
 #include <chrono>
+#include <future>
+#include <random>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <memory>
 
 #define CHAR_SIZE 16u
 #define LINE_SPACE 1.25f
-#define MAX_SIZE_SOUND_POLL 140ull
-#define ROCK 0u
-#define PAPER 1u
-#define SCISSORS 2u
+#define MAX_MIXER_VOICES 4096ull
+#define MIXER_BLOCK_FRAMES 1024ull
+#define MIXER_SAMPLE_RATE 44100u
+#define CONVERSION_BUS_CAPACITY 4096ull
+#define RENDER_CELL_SIZE 128.0f
+#define RENDER_GRID_DRIFT 32.0f
+#define MIN_CAMERA_ZOOM 0.125f
+#define SNAPSHOT_FILE "quicksave.rps"
+#define MAX_OBJECT_COUNT 1048576ll
+#define ARENA_MARGIN 4.0f
 
 
 namespace rps
@@ -35,13 +60,64 @@ namespace rps
 		float speed = 64.0f;
 		float size = 32.0f;
 		float volume = 50.0f;
+
+		unsigned int worldWidth = 720u;
+		unsigned int worldHeight = 720u;
+
+		bool isFlowField = false;
+		float flowCellSize = 16.0f;
+
+		Distribution distribution = Distribution::Uniform;
+		size_t bulkCount = 1000ull;
+
+		bool isGovernor = true;
+
+		// 0 uses every hardware thread
+		size_t jobThreads = 0ull;
+		bool isJobPinning = false;
+
+		size_t historyCapacity = 256ull;
+		size_t historyLevels = 8ull;
+		size_t historyFactor = 4ull;
+	};
+
+	SimulationConfig getSimulationConfig(const GameSettings&);
+
+
+	struct ArenaConfig
+	{
+		// Two or more host that many matches in one window; otherwise the usual single match runs
+		size_t arenas = 0ull;
+
+		// Arena i of n scales the settings' value by getSpreadFactor(i, n, spread)
+		float speedSpread = 0.5f;
+		float sizeSpread = 0.0f;
+
+		// Gives every arena the same seed, so only the varied settings tell them apart
+		bool isSameSeed = false;
+	};
+
+
+	// One of several independent matches shown side by side
+	struct Arena
+	{
+		GameSettings settings;
+		uint32_t seed = 0u;
+		Simulation simulation;
+		uint64_t conversions = 0ull;
+		float tickTime = 0.0f;
+
+		// Placement of the world inside its tile, in window pixels
+		sf::FloatRect tile;
+		sf::Vector2f origin;
+		float scale = 1.0f;
 	};
 
 
 	class Engine
 	{
 	public:
-		Engine();
+		explicit Engine(const std::string& snapshotName = "", const ArenaConfig& arenaConfig = ArenaConfig());
 		void run();
 
 		~Engine();
@@ -56,13 +132,34 @@ namespace rps
 		bool isFullscreen;
 		void setFullscreen();
 
-		std::vector<std::vector<sf::RectangleShape*>> objects;
-		sf::RectangleShape introPreview;
+		sf::Vector2f worldSize;
+		sf::View camera;
+		float cameraZoom;
+		bool isCameraDrag;
+		sf::Vector2i cameraDragPos;
+		void setCamera();
+		void resetCamera();
+		void zoomCamera(float, sf::Vector2i);
+		void panCamera(sf::Vector2f);
+
+		JobSystem jobs;
+
+		Simulation simulation;
+		std::future<std::vector<std::vector<sf::Vector2f>>> pendingObjects;
+		std::future<void> snapshotSave;
+		void saveSnapshot();
+		bool loadSnapshot(const std::string&);
 
-		sf::RectangleShape* createObject(sf::Vector2f, float, uint8_t);
-		inline sf::Vector2f getRandomPos();
+		PlacementConfig placement;
+		size_t bulkCount;
+		void spawnObjects(uint8_t, bool);
+		void despawnObjects(uint8_t, bool);
+		void switchDistribution();
+
+		sf::RectangleShape introPreview;
 
 		long double deltaTime;
+		long double simulationStep;
 		std::chrono::high_resolution_clock timer;
 		std::chrono::steady_clock::time_point startFrameTime;
 
@@ -70,25 +167,54 @@ namespace rps
 
 		size_t FPSLimit;
 		uint8_t types;
-		size_t count;
-		float speed;
-		float size;
 		float volume;
 
 		std::vector<std::string> textureNames;
 		std::vector<sf::Texture*> textures;
+		std::vector<sf::Color> typeColors;
 		sf::Texture* errorTexture;
 
+		sf::RectangleShape objectShape;
+		sf::VertexArray objectBatch;
+		std::vector<size_t> batchSliceStarts;
+		std::vector<size_t> batchSliceSizes;
+		std::vector<SpatialGrid> renderGrids;
+		std::vector<size_t> renderGridObjects;
+		uint64_t renderGridLayout;
+		uint64_t renderGridTick;
+		float renderGridSize;
+		float renderGridDrift;
+		void updateRenderGrids();
+		sf::FloatRect getRenderGridArea(const sf::FloatRect&) const;
+		void drawObjects();
+		size_t buildObjectVertices(uint8_t, const sf::FloatRect&, size_t);
+		size_t packBatchSlices(size_t);
+
+		ArenaConfig arenaConfig;
+		std::vector<std::unique_ptr<Arena>> arenas;
+		size_t selectedArena;
+		sf::Vector2u arenaGrid;
+		sf::VertexArray arenaFrames;
+		std::vector<sf::Text> arenaLabels;
+		void setArenas();
+		void restartArenas();
+		void stepArenas(float);
+		void layoutArenas();
+		void drawArenas();
+		size_t buildArenaVertices(uint8_t, size_t);
+		void setArenaLabels();
+		void selectArena(int, int);
+		void selectArenaAt(sf::Vector2i);
+		Simulation& getControlledSimulation();
+		GameSettings& getControlledSettings();
+
 		std::vector<std::vector<std::string>> soundNames;
 		std::vector<std::vector<sf::SoundBuffer*>> soundBuffers;
-		std::vector<sf::Sound*> soundHeap;
-		std::vector<sf::Sound*> soundPoll;
+		std::vector<std::vector<size_t>> soundClips;
+		SoundMixer mixer;
 		sf::SoundBuffer introBuffer;
 		sf::Sound* introSound;
-		void playSound(sf::SoundBuffer*);
-		void cleanSoundPoll();
-		void clearSoundPoll();
-		void clearSoundHeap();
+		void setMixer();
 
 		std::string fontName;
 		sf::Font font;
@@ -101,6 +227,12 @@ namespace rps
 		bool isF3Menu;
 		void setF3Menu();
 		void setF3MenuStats();
+		std::string getConversionStats() const;
+
+		std::array<AllocStats, static_cast<size_t>(AllocPhase::Count)> allocTotals;
+		std::array<AllocStats, static_cast<size_t>(AllocPhase::Count)> frameAllocs;
+		AllocStats frameAllocTotal;
+		void updateAllocStats();
 		float getHeightOfBottomPanel(std::string&);
 
 		std::vector<sf::Text> controlsTab;
@@ -119,18 +251,50 @@ namespace rps
 		void loadSounds();
 		void loadFont();
 
-		size_t getNearestObject(const sf::Vector2f&, std::vector<sf::RectangleShape*>&);
-		inline void moveTo(sf::RectangleShape*, const sf::Vector2f&, float);
+		std::unique_ptr<ConversionBus> conversionBus;
+		std::unique_ptr<ConversionConsumer> audioConsumer;
+		std::unique_ptr<ConversionConsumer> statsConsumer;
+		std::unique_ptr<ConversionConsumer> logConsumer;
+		std::array<std::atomic<uint64_t>, MAX_TYPES> conversionCounts;
+		std::atomic<float> conversionRate;
+		uint64_t statsWindowCount;
+		std::chrono::steady_clock::time_point statsWindowStart;
+		std::atomic<bool> isConversionLog;
+		void startConsumers();
+		void stopConsumers();
+		void switchConversionLog();
+
+		PopulationHistory history;
+		bool isHistoryGraph;
+		sf::VertexArray historyGraph;
+		std::future<void> historyDump;
+		void recordHistory(float);
+		void drawHistory();
+		void dumpHistory();
 
-		void addObject(uint8_t);
-		void deleteObject(uint8_t);
 		void changeVolume(float);
 		void changeSpeed(float);
 		void changeSize(float);
 		void changeCount(int64_t);
+		void switchSteering();
+		void switchGovernor();
+
+		GovernorConfig governorConfig;
+		QualityGovernor governor;
+		bool isGovernor;
+		size_t retargetInterval;
+		uint8_t renderLOD;
+		size_t soundVoices;
+		void applyQuality();
 
+		bool isIntro;
+		size_t introStep;
+		long double introTime;
+		std::vector<long double> introDelays;
 		void setIntro();
 		void playIntro();
+		void updateIntro();
+		void finishIntro();
 
 		void restart();
 		inline void clearEventPoll();
@@ -0,0 +1,192 @@
+#include "FlowField.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace rps
+{
+// --------------------------------Spatial Grid--------------------------------
+
+	void SpatialGrid::resize(const sf::Vector2f& area, float newCellSize)
+	{
+		cellSize = std::max(newCellSize, 1.0f);
+		cellCount.x = std::max(1u, static_cast<unsigned int>(std::ceil(area.x / cellSize)));
+		cellCount.y = std::max(1u, static_cast<unsigned int>(std::ceil(area.y / cellSize)));
+		cellStart.resize(static_cast<size_t>(cellCount.x) * cellCount.y + 2ull);
+	}
+
+	void SpatialGrid::reserve(size_t objects)
+	{
+		objectCells.reserve(objects);
+		cellObjects.reserve(objects);
+	}
+
+	void SpatialGrid::build(const std::vector<sf::Vector2f>& objects, const std::vector<uint8_t>& alive)
+	{
+		size_t cells = cellStart.size() - 2ull;
+		positions = &objects;
+		std::fill(cellStart.begin(), cellStart.end(), 0u);
+		objectCells.resize(objects.size());
+		cellObjects.resize(objects.size());
+
+		for (size_t i = 0ull; i < objects.size(); ++i)
+		{
+			objectCells[i] = alive[i] ? static_cast<uint32_t>(getCellIndex(objects[i])) : static_cast<uint32_t>(cells);
+			++cellStart[objectCells[i]];
+		}
+		for (size_t cell = 1ull; cell <= cells; ++cell)
+		{
+			cellStart[cell] += cellStart[cell - 1ull];
+		}
+		for (size_t i = objects.size(); i > 0ull; --i)
+		{
+			cellObjects[--cellStart[objectCells[i - 1ull]]] = static_cast<uint32_t>(i - 1ull);
+		}
+		cellStart[cells + 1ull] = static_cast<uint32_t>(objects.size());
+	}
+
+	sf::Vector2i SpatialGrid::getCellCoords(const sf::Vector2f& pos) const
+	{
+		int x = static_cast<int>(std::floor(pos.x / cellSize));
+		int y = static_cast<int>(std::floor(pos.y / cellSize));
+		x = std::max(0, std::min(x, static_cast<int>(cellCount.x) - 1));
+		y = std::max(0, std::min(y, static_cast<int>(cellCount.y) - 1));
+		return sf::Vector2i(x, y);
+	}
+
+	size_t SpatialGrid::getCellIndex(const sf::Vector2f& pos) const
+	{
+		sf::Vector2i coords = getCellCoords(pos);
+		return static_cast<size_t>(coords.y) * cellCount.x + coords.x;
+	}
+
+	sf::Vector2f SpatialGrid::getCellCenter(size_t cell) const
+	{
+		return sf::Vector2f((cell % cellCount.x + 0.5f) * cellSize, (cell / cellCount.x + 0.5f) * cellSize);
+	}
+
+	// The point's own cell comes first, so with a cap the nearest object seen is usually the nearest one
+	size_t SpatialGrid::getNearestObject(const sf::Vector2f& pos, size_t maxCandidates) const
+	{
+		static const int offsets[9][2] = { { 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+		sf::Vector2i coords = getCellCoords(pos);
+		size_t nearest = SIZE_MAX;
+		float nearestDistSqrMag = std::numeric_limits<float>::max();
+		size_t candidates = 0ull;
+
+		for (const auto& offset : offsets)
+		{
+			int x = coords.x + offset[0];
+			int y = coords.y + offset[1];
+			if (x < 0 || y < 0 || x >= static_cast<int>(cellCount.x) || y >= static_cast<int>(cellCount.y))
+				continue;
+			size_t cell = static_cast<size_t>(y) * cellCount.x + x;
+			size_t first = cellStart[cell];
+			size_t last = first + std::min(cellStart[cell + 1ull] - first, maxCandidates - candidates);
+			for (size_t i = first; i < last; ++i)
+			{
+				sf::Vector2f dist = getPosition(cellObjects[i]) - pos;
+				float distSqrMag = dist.x * dist.x + dist.y * dist.y;
+				if (distSqrMag < nearestDistSqrMag)
+				{
+					nearest = cellObjects[i];
+					nearestDistSqrMag = distSqrMag;
+				}
+			}
+			candidates += last - first;
+			if (candidates == maxCandidates)
+				break;
+		}
+		return nearest;
+	}
+
+// --------------------------------Flow Field--------------------------------
+
+	void FlowField::build(const SpatialGrid& sourceGrid)
+	{
+		grid = &sourceGrid;
+		sf::Vector2u cellCount = grid->getCellCount();
+		size_t cells = static_cast<size_t>(cellCount.x) * cellCount.y;
+
+		sources.resize(cells);
+		distances.assign(cells, std::numeric_limits<float>::max());
+		isQueued.assign(cells, 0u);
+		queue.resize(cells);
+		size_t head = 0ull;
+		size_t queued = 0ull;
+
+		for (size_t cell = 0ull; cell < cells; ++cell)
+		{
+			sf::Vector2f center = grid->getCellCenter(cell);
+			grid->forEachInCell(static_cast<int>(cell % cellCount.x), static_cast<int>(cell / cellCount.x), [&](uint32_t object)
+			{
+				const sf::Vector2f& pos = grid->getPosition(object);
+				sf::Vector2f dist = pos - center;
+				float distMag = std::sqrt(dist.x * dist.x + dist.y * dist.y);
+				if (distMag < distances[cell])
+				{
+					distances[cell] = distMag;
+					sources[cell] = pos;
+				}
+			});
+			if (distances[cell] != std::numeric_limits<float>::max())
+			{
+				queue[queued++] = static_cast<uint32_t>(cell);
+				isQueued[cell] = 1u;
+			}
+		}
+
+		// Every cell is in the queue at most once at a time, so a ring of `cells` entries never overflows
+		while (queued != 0ull)
+		{
+			uint32_t cell = queue[head];
+			head = (head + 1ull) % cells;
+			--queued;
+			isQueued[cell] = 0u;
+
+			int cellX = cell % cellCount.x;
+			int cellY = cell / cellCount.x;
+			for (int y = std::max(cellY - 1, 0); y <= std::min(cellY + 1, static_cast<int>(cellCount.y) - 1); ++y)
+			{
+				for (int x = std::max(cellX - 1, 0); x <= std::min(cellX + 1, static_cast<int>(cellCount.x) - 1); ++x)
+				{
+					size_t neighbour = static_cast<size_t>(y) * cellCount.x + x;
+					sf::Vector2f dist = sources[cell] - grid->getCellCenter(neighbour);
+					float distMag = std::sqrt(dist.x * dist.x + dist.y * dist.y);
+					if (distMag < distances[neighbour])
+					{
+						distances[neighbour] = distMag;
+						sources[neighbour] = sources[cell];
+						if (!isQueued[neighbour])
+						{
+							queue[(head + queued++) % cells] = static_cast<uint32_t>(neighbour);
+							isQueued[neighbour] = 1u;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	sf::Vector2f FlowField::getNearestSource(const sf::Vector2f& pos) const
+	{
+		return sources[grid->getCellIndex(pos)];
+	}
+
+	sf::Vector2f FlowField::getGradient(const sf::Vector2f& pos) const
+	{
+		sf::Vector2f away = pos - getNearestSource(pos);
+		float mag = std::sqrt(away.x * away.x + away.y * away.y);
+		if (mag == 0.0f)
+			return sf::Vector2f(0.0f, 0.0f);
+		return sf::Vector2f(away.x / mag, away.y / mag);
+	}
+
+	float FlowField::getDistance(const sf::Vector2f& pos) const
+	{
+		sf::Vector2f dist = pos - getNearestSource(pos);
+		return std::sqrt(dist.x * dist.x + dist.y * dist.y);
+	}
+}
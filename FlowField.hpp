@@ -0,0 +1,107 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+
+#include <vector>
+#include <cstdint>
+
+
+namespace rps
+{
+	// Uniform grid of buckets over the playfield, refilled with a counting sort.
+	// Buckets hold indices into the position array it was built from, which is read live,
+	// so the array may grow after build() but must not be reordered until the next build().
+	// Objects flagged dead at build time go to one more bucket past the last cell, which no lookup visits.
+	class SpatialGrid
+	{
+	public:
+		void resize(const sf::Vector2f& area, float cellSize);
+		void reserve(size_t objects);
+		void build(const std::vector<sf::Vector2f>& positions, const std::vector<uint8_t>& alive);
+
+		size_t getCellIndex(const sf::Vector2f&) const;
+		sf::Vector2i getCellCoords(const sf::Vector2f&) const;
+		sf::Vector2f getCellCenter(size_t) const;
+
+		sf::Vector2u getCellCount() const { return cellCount; }
+		float getCellSize() const { return cellSize; }
+		// True until a build() that saw live objects
+		bool isEmpty() const { return cellStart.size() < 2ull || cellStart[cellStart.size() - 2ull] == 0u; }
+		const sf::Vector2f& getPosition(uint32_t index) const { return (*positions)[index]; }
+
+		// Nearest of at most `maxCandidates` objects in the 3x3 cells around the point;
+		// returns SIZE_MAX when those cells are empty
+		size_t getNearestObject(const sf::Vector2f&, size_t maxCandidates = SIZE_MAX) const;
+
+		template<typename Function>
+		void forEachInCell(int x, int y, Function function) const
+		{
+			if (x < 0 || y < 0 || x >= static_cast<int>(cellCount.x) || y >= static_cast<int>(cellCount.y))
+				return;
+			size_t cell = static_cast<size_t>(y) * cellCount.x + x;
+			for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1ull]; ++i)
+			{
+				function(cellObjects[i]);
+			}
+		}
+
+		template<typename Function>
+		void forEachInArea(const sf::FloatRect& area, Function function) const
+		{
+			sf::Vector2i first = getCellCoords(sf::Vector2f(area.left, area.top));
+			sf::Vector2i last = getCellCoords(sf::Vector2f(area.left + area.width, area.top + area.height));
+			for (int y = first.y; y <= last.y; ++y)
+			{
+				forEachInRow(y, first.x, last.x, function);
+			}
+		}
+
+		// Cells of a row are adjacent in the buckets, so a run of them is one contiguous range.
+		// Coordinates must be inside the grid, as getCellCoords() returns them.
+		template<typename Function>
+		void forEachInRow(int y, int firstX, int lastX, Function function) const
+		{
+			size_t row = static_cast<size_t>(y) * cellCount.x;
+			for (uint32_t i = cellStart[row + firstX]; i < cellStart[row + lastX + 1ull]; ++i)
+			{
+				function(cellObjects[i]);
+			}
+		}
+
+		size_t getRowObjectCount(int y, int firstX, int lastX) const
+		{
+			size_t row = static_cast<size_t>(y) * cellCount.x;
+			return cellStart[row + lastX + 1ull] - cellStart[row + firstX];
+		}
+
+	private:
+		sf::Vector2u cellCount;
+		float cellSize = 0.0f;
+		const std::vector<sf::Vector2f>* positions = nullptr;
+
+		std::vector<uint32_t> cellStart;
+		std::vector<uint32_t> objectCells;
+		std::vector<uint32_t> cellObjects;
+	};
+
+
+	// Distance field to the nearest object of one type, propagated over a SpatialGrid
+	// by a multi-source BFS. Each cell keeps the position of the source that reached it,
+	// so the gradient of the field at any point is the direction away from that source.
+	class FlowField
+	{
+	public:
+		void build(const SpatialGrid&);
+
+		sf::Vector2f getNearestSource(const sf::Vector2f&) const;
+		sf::Vector2f getGradient(const sf::Vector2f&) const;
+		float getDistance(const sf::Vector2f&) const;
+
+	private:
+		const SpatialGrid* grid = nullptr;
+
+		std::vector<sf::Vector2f> sources;
+		std::vector<float> distances;
+		std::vector<uint32_t> queue;
+		std::vector<uint8_t> isQueued;
+	};
+}
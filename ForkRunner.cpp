@@ -0,0 +1,157 @@
+#include "ForkRunner.hpp"
+#include "Simulation.hpp"
+#include "AllocTracker.hpp"
+#include "JobSystem.hpp"
+#include "Tracer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+
+namespace rps
+{
+	namespace
+	{
+		struct ForkResult
+		{
+			bool isLoaded = false;
+			float speed = 0.0f;
+			float size = 0.0f;
+			uint64_t ticks = 0ull;
+			size_t counts[MAX_TYPES] = {};
+			uint8_t survivors = 0u;
+			uint8_t winner = 0u;
+		};
+
+		uint8_t getSurvivors(const Simulation& simulation, uint8_t& winner)
+		{
+			uint8_t survivors = 0u;
+			for (uint8_t type = ROCK; type < simulation.getConfig().types; ++type)
+			{
+				if (simulation.getCount(type) == 0ull)
+					continue;
+				winner = type;
+				++survivors;
+			}
+			return survivors;
+		}
+
+		std::string getForkName(const std::string& snapshotName, size_t fork)
+		{
+			std::string base = snapshotName;
+			size_t extension = base.rfind(".rps");
+			if (extension != std::string::npos && extension == base.size() - 4ull)
+				base.erase(extension);
+			return base + "_fork" + std::to_string(fork) + ".rps";
+		}
+	}
+
+	float getSpreadFactor(size_t index, size_t count, float spread)
+	{
+		if (count < 2ull)
+			return 1.0f;
+		return 1.0f + spread * (2.0f * index / (count - 1ull) - 1.0f);
+	}
+
+	bool runForks(const ForkConfig& forkConfig)
+	{
+		SnapshotFile file;
+		if (!file.open(forkConfig.snapshotName))
+			return false;
+		if (file.getHeader().types > MAX_TYPES)
+		{
+			std::cout << forkConfig.snapshotName << " has more types than this build supports" << std::endl;
+			return false;
+		}
+
+		JobSystemConfig jobConfig;
+		jobConfig.threads = forkConfig.threads;
+		JobSystem jobs;
+		jobs.start(jobConfig);
+		std::cout << "Forking " << forkConfig.snapshotName << " at tick " << file.getHeader().tick << " into "
+			<< forkConfig.forks << " continuations of " << forkConfig.ticks << " ticks on " << jobs.getThreadCount() << " threads..." << std::endl;
+
+		std::vector<ForkResult> results(forkConfig.forks);
+		AllocStats allocsBefore = AllocTracker::getTotal();
+		auto startTime = std::chrono::steady_clock::now();
+
+		// One fork per job; a fork's own flow field rebuilds go to the same pool and run on whichever threads are idle
+		jobs.parallelFor(forkConfig.forks, 1ull, [&](size_t firstFork, size_t lastFork)
+		{
+			ALLOC_PHASE(Simulation);
+			for (size_t fork = firstFork; fork < lastFork; ++fork)
+			{
+				TRACE_SCOPE("Fork");
+				ForkResult& result = results[fork];
+				Simulation simulation;
+				if (!simulation.loadSnapshot(file))
+					continue;
+				simulation.setJobSystem(&jobs);
+				result.isLoaded = true;
+
+				simulation.setSpeed(simulation.getConfig().speed * getSpreadFactor(fork, forkConfig.forks, forkConfig.speedSpread));
+				simulation.setSize(std::fmaxf(1.0f, simulation.getConfig().size * getSpreadFactor(fork, forkConfig.forks, forkConfig.sizeSpread)));
+				result.speed = simulation.getConfig().speed;
+				result.size = simulation.getConfig().size;
+
+				uint64_t firstTick = simulation.getTick();
+				while (simulation.getTick() - firstTick < forkConfig.ticks && getSurvivors(simulation, result.winner) > 1u)
+				{
+					simulation.step(forkConfig.timeStep);
+				}
+
+				result.ticks = simulation.getTick() - firstTick;
+				result.survivors = getSurvivors(simulation, result.winner);
+				for (uint8_t type = ROCK; type < simulation.getConfig().types; ++type)
+				{
+					result.counts[type] = simulation.getCount(type);
+				}
+
+				if (forkConfig.isSaveForks)
+				{
+					std::vector<char> buffer;
+					simulation.saveSnapshot(buffer);
+					SnapshotFile::write(getForkName(forkConfig.snapshotName, fork), buffer);
+				}
+			}
+		});
+
+		float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+		AllocStats allocs = AllocTracker::getTotal() - allocsBefore;
+		uint64_t totalTicks = 0ull;
+		const char* typeNames[MAX_TYPES] = { "Rocks", "Papers", "Scissors" };
+
+		std::cout << std::endl << "Fork\tSpeed\tSize\tTicks";
+		for (uint8_t type = ROCK; type < file.getHeader().types; ++type)
+		{
+			std::cout << '\t' << typeNames[type];
+		}
+		std::cout << "\tWinner" << std::endl;
+
+		bool isSuccess = true;
+		for (size_t fork = 0ull; fork < results.size(); ++fork)
+		{
+			const ForkResult& result = results[fork];
+			if (!result.isLoaded)
+			{
+				std::cout << fork << "\tfailed to load" << std::endl;
+				isSuccess = false;
+				continue;
+			}
+			totalTicks += result.ticks;
+			std::cout << fork << '\t' << result.speed << '\t' << result.size << '\t' << result.ticks;
+			for (uint8_t type = ROCK; type < file.getHeader().types; ++type)
+			{
+				std::cout << '\t' << result.counts[type];
+			}
+			std::cout << '\t' << (result.survivors == 1u ? typeNames[result.winner] : "-") << std::endl;
+		}
+		std::cout << std::endl << "Done in " << elapsed << " s" << std::endl;
+		std::cout << "Allocations: " << allocs.allocations << " (" << allocs.bytes << " B), "
+			<< (totalTicks != 0ull ? static_cast<double>(allocs.allocations) / totalTicks : 0.0) << " per tick" << std::endl;
+		return isSuccess;
+	}
+}
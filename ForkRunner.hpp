@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+
+namespace rps
+{
+	struct ForkConfig
+	{
+		std::string snapshotName;
+		size_t forks = 8ull;
+
+		// 0 uses every hardware thread
+		size_t threads = 0ull;
+		uint64_t ticks = 8640ull;
+		float timeStep = 1.0f / 144.0f;
+
+		// Continuation i of n scales the snapshot's value by getSpreadFactor(i, n, spread)
+		float speedSpread = 0.5f;
+		float sizeSpread = 0.0f;
+
+		bool isSaveForks = false;
+	};
+
+
+	// Factor for variant i of n: 1 + spread * (2i / (n - 1) - 1), so the variants cover
+	// [1 - spread, 1 + spread] evenly; a single variant keeps the base value
+	float getSpreadFactor(size_t index, size_t count, float spread);
+
+
+	// Headless: continues one snapshot as many independent matches with varied parameters,
+	// spread over a job system whose threads all read the same mapping of the snapshot file.
+	// A continuation stops early once a single type is left.
+	bool runForks(const ForkConfig&);
+}
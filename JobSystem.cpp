@@ -0,0 +1,225 @@
+#include "JobSystem.hpp"
+#include "Tracer.hpp"
+
+#include <Windows.h>
+
+#include <algorithm>
+
+
+namespace rps
+{
+	namespace
+	{
+		thread_local const JobSystem* threadJobs = nullptr;
+		thread_local size_t threadQueue = 0ull;
+
+		void pinThread(size_t core)
+		{
+			size_t cores = std::max(1u, std::thread::hardware_concurrency());
+			SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1ull) << (core % cores % 64ull));
+		}
+	}
+
+// --------------------------------Task Graph--------------------------------
+
+	TaskGraph::Task TaskGraph::add(std::function<void()> function)
+	{
+		Node node;
+		node.function = std::move(function);
+		nodes.push_back(std::move(node));
+		return nodes.size() - 1ull;
+	}
+
+	void TaskGraph::precede(Task before, Task after)
+	{
+		nodes[before].successors.push_back(after);
+		++nodes[after].predecessors;
+	}
+
+	void TaskGraph::clear()
+	{
+		nodes.clear();
+	}
+
+// --------------------------------Work Queue--------------------------------
+
+	bool JobSystem::WorkQueue::push(const QueuedJob& job)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (size == capacity)
+			return false;
+		jobs[(head + size) % capacity] = job;
+		++size;
+		return true;
+	}
+
+	bool JobSystem::WorkQueue::pop(QueuedJob& job)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (size == 0ull)
+			return false;
+		--size;
+		job = jobs[(head + size) % capacity];
+		return true;
+	}
+
+	bool JobSystem::WorkQueue::steal(QueuedJob& job)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (size == 0ull)
+			return false;
+		job = jobs[head];
+		head = (head + 1ull) % capacity;
+		--size;
+		return true;
+	}
+
+// --------------------------------Job System--------------------------------
+
+	JobSystem::~JobSystem()
+	{
+		stop();
+	}
+
+	void JobSystem::start(const JobSystemConfig& newConfig)
+	{
+		stop();
+		config = newConfig;
+		size_t threads = config.threads != 0ull ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+
+		queueCount = threads;
+		queues.reset(new WorkQueue[queueCount]);
+		isStopping.store(false);
+		if (config.isPinned)
+			pinThread(0ull);
+
+		for (size_t i = 1ull; i < threads; ++i)
+		{
+			workers.push_back(std::thread(&JobSystem::work, this, i));
+		}
+	}
+
+	void JobSystem::stop()
+	{
+		if (workers.empty())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			isStopping.store(true);
+		}
+		wake.notify_all();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+		workers.clear();
+	}
+
+	size_t JobSystem::getQueueIndex() const
+	{
+		return threadJobs == this ? threadQueue : 0ull;
+	}
+
+	void JobSystem::submit(const Job& job, JobCounter& counter)
+	{
+		counter.pending.fetch_add(1ull, std::memory_order_relaxed);
+		queued.fetch_add(1ull, std::memory_order_relaxed);
+		if (workers.empty() || !queues[getQueueIndex()].push(QueuedJob{ job, &counter, AllocTracker::getPhase() }))
+		{
+			queued.fetch_sub(1ull, std::memory_order_relaxed);
+			job.function(job.data, job.first, job.last);
+			counter.pending.fetch_sub(1ull, std::memory_order_release);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+		}
+		wake.notify_one();
+	}
+
+	// Own deque first, newest job first, so a thread keeps working on what it just split up
+	bool JobSystem::runOne(size_t queueIndex)
+	{
+		QueuedJob queuedJob;
+		bool isFound = queues[queueIndex].pop(queuedJob);
+		for (size_t i = 1ull; !isFound && i < queueCount; ++i)
+		{
+			isFound = queues[(queueIndex + i) % queueCount].steal(queuedJob);
+		}
+		if (!isFound)
+			return false;
+
+		queued.fetch_sub(1ull, std::memory_order_relaxed);
+		{
+			AllocPhaseScope phaseScope(queuedJob.phase);
+			queuedJob.job.function(queuedJob.job.data, queuedJob.job.first, queuedJob.job.last);
+		}
+		queuedJob.counter->pending.fetch_sub(1ull, std::memory_order_release);
+		return true;
+	}
+
+	void JobSystem::wait(JobCounter& counter)
+	{
+		size_t queueIndex = getQueueIndex();
+		while (!counter.isDone())
+		{
+			if (queues == nullptr || !runOne(queueIndex))
+				std::this_thread::yield();
+		}
+	}
+
+	void JobSystem::work(size_t queueIndex)
+	{
+		TRACE_THREAD_NAME("Job Worker");
+		threadJobs = this;
+		threadQueue = queueIndex;
+		if (config.isPinned)
+			pinThread(queueIndex);
+
+		while (true)
+		{
+			if (runOne(queueIndex))
+				continue;
+
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wake.wait(lock, [&]() { return isStopping.load() || queued.load() != 0ull; });
+			if (isStopping.load() && queued.load() == 0ull)
+				return;
+		}
+	}
+
+	void JobSystem::run(TaskGraph& graph)
+	{
+		if (graph.remainingSize != graph.nodes.size())
+		{
+			graph.remaining.reset(new std::atomic<size_t>[graph.nodes.size()]);
+			graph.remainingSize = graph.nodes.size();
+		}
+		for (size_t node = 0ull; node < graph.nodes.size(); ++node)
+		{
+			graph.remaining[node].store(graph.nodes[node].predecessors, std::memory_order_relaxed);
+		}
+
+		JobCounter counter;
+		graph.jobs = this;
+		graph.counter = &counter;
+		for (size_t node = 0ull; node < graph.nodes.size(); ++node)
+		{
+			if (graph.nodes[node].predecessors == 0ull)
+				submit(Job{ &JobSystem::runNode, &graph, node, node + 1ull }, counter);
+		}
+		wait(counter);
+	}
+
+	// A successor is submitted before this node's job counts as done, so the counter cannot reach zero early
+	void JobSystem::runNode(void* data, size_t node, size_t)
+	{
+		TaskGraph& graph = *static_cast<TaskGraph*>(data);
+		graph.nodes[node].function();
+		for (TaskGraph::Task successor : graph.nodes[node].successors)
+		{
+			if (graph.remaining[successor].fetch_sub(1ull, std::memory_order_acq_rel) == 1ull)
+				graph.jobs->submit(Job{ &JobSystem::runNode, &graph, successor, successor + 1ull }, *graph.counter);
+		}
+	}
+}
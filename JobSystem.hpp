@@ -0,0 +1,170 @@
+#pragma once
+#include "AllocTracker.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace rps
+{
+	struct JobSystemConfig
+	{
+		// Threads running jobs, the one calling start() included; 0 uses every hardware thread
+		size_t threads = 0ull;
+
+		// Binds the calling thread to core 0 and worker i to core i + 1
+		bool isPinned = false;
+	};
+
+
+	class JobCounter
+	{
+	public:
+		bool isDone() const { return pending.load(std::memory_order_acquire) == 0ull; }
+
+	private:
+		friend class JobSystem;
+		std::atomic<size_t> pending{ 0ull };
+	};
+
+
+	// A plain function over a range, so submitting work never allocates
+	struct Job
+	{
+		void (*function)(void* data, size_t first, size_t last) = nullptr;
+		void* data = nullptr;
+		size_t first = 0ull;
+		size_t last = 0ull;
+	};
+
+
+	class JobSystem;
+
+
+	// Tasks run once every task that precedes them is done; the graph is built once and run any number of times
+	class TaskGraph
+	{
+	public:
+		typedef size_t Task;
+
+		Task add(std::function<void()>);
+		void precede(Task before, Task after);
+		void clear();
+
+		bool isEmpty() const { return nodes.empty(); }
+
+	private:
+		friend class JobSystem;
+
+		struct Node
+		{
+			std::function<void()> function;
+			std::vector<Task> successors;
+			size_t predecessors = 0ull;
+		};
+
+		std::vector<Node> nodes;
+		std::unique_ptr<std::atomic<size_t>[]> remaining;
+		size_t remainingSize = 0ull;
+		JobSystem* jobs = nullptr;
+		JobCounter* counter = nullptr;
+	};
+
+
+	// Work-stealing pool: every worker owns a deque it pushes to and pops from at the back,
+	// idle workers steal from the front of the others'. Threads outside the pool share one more deque.
+	// wait() runs queued jobs instead of blocking, so jobs may submit and wait for jobs of their own.
+	// Deques have a fixed capacity: a job that does not fit runs right away on the submitting thread.
+	class JobSystem
+	{
+	public:
+		~JobSystem();
+
+		void start(const JobSystemConfig&);
+		void stop();
+
+		size_t getThreadCount() const { return workers.size() + 1ull; }
+		bool isPinned() const { return config.isPinned; }
+
+		void submit(const Job&, JobCounter&);
+		void wait(JobCounter&);
+
+		void run(TaskGraph&);
+
+		// Calls function(first, last) over ranges of at most `grain` items that cover [0, items)
+		// and returns once all of them are done. The calling thread takes the first range.
+		template<typename Function>
+		void parallelFor(size_t items, size_t grain, const Function& function)
+		{
+			if (items == 0ull)
+				return;
+			grain = grain != 0ull ? grain : 1ull;
+			if (workers.empty() || items <= grain)
+			{
+				function(0ull, items);
+				return;
+			}
+
+			Job job;
+			job.function = [](void* data, size_t first, size_t last)
+			{
+				(*static_cast<const Function*>(data))(first, last);
+			};
+			job.data = const_cast<void*>(static_cast<const void*>(&function));
+
+			JobCounter counter;
+			for (size_t first = grain; first < items; first += grain)
+			{
+				job.first = first;
+				job.last = items - first > grain ? first + grain : items;
+				submit(job, counter);
+			}
+			function(0ull, grain);
+			wait(counter);
+		}
+
+	private:
+		// Allocations a job makes are counted under the phase of the thread that submitted it
+		struct QueuedJob
+		{
+			Job job;
+			JobCounter* counter;
+			AllocPhase phase;
+		};
+
+		struct WorkQueue
+		{
+			static const size_t capacity = 1024ull;
+			std::mutex mutex;
+			QueuedJob jobs[capacity];
+			size_t head = 0ull;
+			size_t size = 0ull;
+
+			bool push(const QueuedJob&);
+			bool pop(QueuedJob&);
+			bool steal(QueuedJob&);
+		};
+
+		JobSystemConfig config;
+		std::vector<std::thread> workers;
+		std::unique_ptr<WorkQueue[]> queues;
+		size_t queueCount = 0ull;
+
+		std::atomic<size_t> queued{ 0ull };
+		std::atomic<bool> isStopping{ false };
+		std::mutex wakeMutex;
+		std::condition_variable wake;
+
+		size_t getQueueIndex() const;
+		bool runOne(size_t queueIndex);
+		void work(size_t queueIndex);
+
+		static void runNode(void* data, size_t node, size_t);
+	};
+}
@@ -0,0 +1,239 @@
+#include "Placement.hpp"
+#include "Tracer.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+namespace rps
+{
+	namespace
+	{
+		const size_t chunkSize = 16384ull;
+		const size_t poissonRounds = 12ull;
+		const float poissonDensity = 0.55f;
+
+		// splitmix64: a whole generator in one word, cheap enough to give every chunk, or every cell, its own stream
+		struct ChunkRandom
+		{
+			uint64_t state;
+
+			ChunkRandom(uint64_t seed, uint64_t stream) : state(seed ^ (stream * 0xD1B54A32D192ED03ull))
+			{
+				next();
+			}
+
+			uint64_t next()
+			{
+				uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				return z ^ (z >> 31);
+			}
+
+			float getFloat()
+			{
+				return (next() >> 40) * (1.0f / 16777216.0f);
+			}
+
+			float getRange(float min, float max)
+			{
+				return min + (max - min) * getFloat();
+			}
+
+			float getGaussian()
+			{
+				float radius = std::sqrt(-2.0f * std::log(1.0f - getFloat()));
+				return radius * std::cos(6.2831853f * getFloat());
+			}
+		};
+
+		// Chunks, not threads, own the generators, so the job system may split them up any way it likes
+		template<typename Function>
+		void forEachChunk(JobSystem* jobs, size_t items, size_t chunkItems, const Function& function)
+		{
+			size_t chunks = (items + chunkItems - 1ull) / chunkItems;
+			auto work = [&](size_t firstChunk, size_t lastChunk)
+			{
+				for (size_t chunk = firstChunk; chunk < lastChunk; ++chunk)
+				{
+					function(chunk, chunk * chunkItems, std::min(items, chunk * chunkItems + chunkItems));
+				}
+			};
+
+			if (jobs != nullptr)
+				jobs->parallelFor(chunks, 1ull, work);
+			else
+				work(0ull, chunks);
+		}
+
+		void placeUniform(sf::Vector2f* positions, size_t count, const sf::FloatRect& region, uint64_t seed, JobSystem* jobs)
+		{
+			forEachChunk(jobs, count, chunkSize, [&](size_t chunk, size_t first, size_t last)
+			{
+				ChunkRandom random(seed, chunk);
+				for (size_t i = first; i < last; ++i)
+				{
+					positions[i] = sf::Vector2f(random.getRange(region.left, region.left + region.width), random.getRange(region.top, region.top + region.height));
+				}
+			});
+		}
+
+		void placeClustered(sf::Vector2f* positions, size_t count, const sf::FloatRect& region, const PlacementConfig& placement, uint64_t seed, JobSystem* jobs)
+		{
+			ChunkRandom centerRandom(seed, UINT64_MAX);
+			std::vector<sf::Vector2f> centers(std::max(placement.clusters, static_cast<size_t>(1ull)));
+			for (auto& center : centers)
+			{
+				center = sf::Vector2f(centerRandom.getRange(region.left, region.left + region.width), centerRandom.getRange(region.top, region.top + region.height));
+			}
+
+			forEachChunk(jobs, count, chunkSize, [&](size_t chunk, size_t first, size_t last)
+			{
+				ChunkRandom random(seed, chunk);
+				for (size_t i = first; i < last; ++i)
+				{
+					const sf::Vector2f& center = centers[random.next() % centers.size()];
+					float x = center.x + random.getGaussian() * placement.clusterRadius;
+					float y = center.y + random.getGaussian() * placement.clusterRadius;
+					positions[i] = sf::Vector2f(std::fmax(region.left, std::fmin(x, region.left + region.width)), std::fmax(region.top, std::fmin(y, region.top + region.height)));
+				}
+			});
+		}
+
+		// Parallel dart throwing on a grid of cells no wider than the spacing / sqrt(2), so a cell holds
+		// at most one point. Each round visits the cells in 25 phases of a 5x5 pattern: cells of one phase
+		// are 5 apart and a candidate only reads the 2 cells around it, so a phase runs fully in parallel.
+		// Rounds stop early once enough cells are filled.
+		size_t placePoissonDisk(sf::Vector2f* positions, size_t count, const sf::FloatRect& region, float minDistance, uint64_t seed, JobSystem* jobs)
+		{
+			float distance = minDistance > 0.0f ? minDistance : std::sqrt(poissonDensity * region.width * region.height / count);
+			float cellSize = distance / std::sqrt(2.0f);
+			size_t cellsX = std::max(static_cast<size_t>(1ull), static_cast<size_t>(std::ceil(region.width / cellSize)));
+			size_t cellsY = std::max(static_cast<size_t>(1ull), static_cast<size_t>(std::ceil(region.height / cellSize)));
+			size_t cells = cellsX * cellsY;
+
+			std::vector<sf::Vector2f> cellPoints(cells);
+			std::vector<uint8_t> isFilled(cells, 0u);
+			float sqrDistance = distance * distance;
+
+			size_t filled = 0ull;
+			for (size_t round = 0ull; round < poissonRounds && filled < count; ++round)
+			{
+				for (size_t phase = 0ull; phase < 25ull; ++phase)
+				{
+					size_t phaseX = phase % 5ull;
+					size_t phaseY = phase / 5ull;
+					size_t columns = cellsX > phaseX ? (cellsX - phaseX + 4ull) / 5ull : 0ull;
+					size_t rows = cellsY > phaseY ? (cellsY - phaseY + 4ull) / 5ull : 0ull;
+
+					forEachChunk(jobs, columns * rows, chunkSize, [&](size_t, size_t first, size_t last)
+					{
+						for (size_t i = first; i < last; ++i)
+						{
+							size_t x = phaseX + i % columns * 5ull;
+							size_t y = phaseY + i / columns * 5ull;
+							size_t cell = y * cellsX + x;
+							if (isFilled[cell])
+								continue;
+
+							ChunkRandom random(seed, round * cells + cell);
+							sf::Vector2f candidate(region.left + (x + random.getFloat()) * cellSize, region.top + (y + random.getFloat()) * cellSize);
+							if (candidate.x >= region.left + region.width || candidate.y >= region.top + region.height)
+								continue;
+
+							bool isFree = true;
+							for (size_t ny = y < 2ull ? 0ull : y - 2ull; isFree && ny <= std::min(y + 2ull, cellsY - 1ull); ++ny)
+							{
+								for (size_t nx = x < 2ull ? 0ull : x - 2ull; nx <= std::min(x + 2ull, cellsX - 1ull); ++nx)
+								{
+									size_t neighbour = ny * cellsX + nx;
+									if (!isFilled[neighbour])
+										continue;
+									sf::Vector2f dist = cellPoints[neighbour] - candidate;
+									if (dist.x * dist.x + dist.y * dist.y < sqrDistance)
+									{
+										isFree = false;
+										break;
+									}
+								}
+							}
+							if (isFree)
+							{
+								cellPoints[cell] = candidate;
+								isFilled[cell] = 1u;
+							}
+						}
+					});
+				}
+				filled = std::count(isFilled.begin(), isFilled.end(), 1u);
+			}
+
+			// Selection sampling keeps a uniform random subset when more points fit than were asked for,
+			// so trimming has no spatial bias
+			size_t placed = std::min(count, filled);
+			size_t needed = placed;
+			size_t remaining = filled;
+			size_t written = 0ull;
+			ChunkRandom random(seed, UINT64_MAX);
+			for (size_t cell = 0ull; cell < cells && needed != 0ull; ++cell)
+			{
+				if (!isFilled[cell])
+					continue;
+				if (random.next() % remaining < needed)
+				{
+					positions[written++] = cellPoints[cell];
+					--needed;
+				}
+				--remaining;
+			}
+			return placed;
+		}
+	}
+
+	const char* getDistributionName(Distribution distribution)
+	{
+		switch (distribution)
+		{
+		case Distribution::Uniform:
+			return "Uniform";
+		case Distribution::Clustered:
+			return "Clustered";
+		case Distribution::PoissonDisk:
+			return "Poisson Disk";
+		case Distribution::Regions:
+			return "Regions";
+		default:
+			return "Unknown";
+		}
+	}
+
+	size_t placeObjects(sf::Vector2f* positions, size_t count, uint8_t type, uint8_t types,
+		const sf::Vector2f& area, const PlacementConfig& placement, uint64_t seed, JobSystem* jobs)
+	{
+		TRACE_SCOPE("placeObjects");
+		if (count == 0ull)
+			return 0ull;
+
+		sf::FloatRect region(0.0f, 0.0f, area.x, area.y);
+		switch (placement.distribution)
+		{
+		case Distribution::Clustered:
+			placeClustered(positions, count, region, placement, seed, jobs);
+			return count;
+		case Distribution::PoissonDisk:
+			return placePoissonDisk(positions, count, region, placement.minDistance, seed, jobs);
+		case Distribution::Regions:
+			region.width = area.x / std::max(types, static_cast<uint8_t>(1u));
+			region.left = region.width * type;
+			placeUniform(positions, count, region, seed, jobs);
+			return count;
+		default:
+			placeUniform(positions, count, region, seed, jobs);
+			return count;
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <SFML/System.hpp>
+
+#include "JobSystem.hpp"
+
+#include <cstdint>
+
+
+namespace rps
+{
+	enum class Distribution : uint8_t
+	{
+		Uniform,
+		Clustered,
+		PoissonDisk,
+		Regions,
+		Count
+	};
+
+	const char* getDistributionName(Distribution);
+
+
+	struct PlacementConfig
+	{
+		Distribution distribution = Distribution::Uniform;
+
+		size_t clusters = 6ull;
+		float clusterRadius = 48.0f;
+
+		// Poisson-disk spacing; 0 derives it from the area and count so that the count fits
+		float minDistance = 0.0f;
+	};
+
+
+	// Writes up to `count` positions of one type into `positions`, which must have room for them,
+	// and returns how many were placed: only Poisson-disk may place fewer, when the spacing does not fit.
+	// Work is split into fixed chunks, each with its own generator derived from the seed,
+	// so the result is the same on any number of threads. Runs serially without a job system.
+	size_t placeObjects(sf::Vector2f* positions, size_t count, uint8_t type, uint8_t types,
+		const sf::Vector2f& area, const PlacementConfig&, uint64_t seed, JobSystem*);
+}
@@ -0,0 +1,119 @@
+#include "PopulationHistory.hpp"
+
+#include <algorithm>
+
+
+namespace rps
+{
+	void PopulationHistory::configure(uint8_t newTypes, size_t newCapacity, size_t newLevels, size_t newFactor)
+	{
+		types = newTypes;
+		capacity = std::max<size_t>(newCapacity, 1ull);
+		levels = std::max<size_t>(newLevels, 1ull);
+		factor = std::max<size_t>(newFactor, 2ull);
+
+		samples.resize(levels * capacity * getSampleWidth());
+		sampleTicks.resize(levels * capacity);
+		accumulators.resize(levels * getSampleWidth());
+		accumulated.resize(levels);
+		pushed.resize(levels);
+		scratch.resize(getSampleWidth());
+		clear();
+	}
+
+	void PopulationHistory::clear()
+	{
+		std::fill(samples.begin(), samples.end(), 0.0f);
+		std::fill(sampleTicks.begin(), sampleTicks.end(), 0ull);
+		std::fill(accumulators.begin(), accumulators.end(), 0.0f);
+		std::fill(accumulated.begin(), accumulated.end(), 0ull);
+		std::fill(pushed.begin(), pushed.end(), 0ull);
+	}
+
+	void PopulationHistory::record(uint64_t tick, const float* population, float conversionRate, float tickTime)
+	{
+		std::copy(population, population + types, scratch.begin());
+		scratch[types] = conversionRate;
+		scratch[types + 1ull] = tickTime;
+		push(0ull, scratch.data(), tick);
+	}
+
+	void PopulationHistory::push(size_t level, const float* sample, uint64_t tick)
+	{
+		size_t width = getSampleWidth();
+		size_t slot = pushed[level] % capacity;
+		std::copy(sample, sample + width, samples.begin() + (level * capacity + slot) * width);
+		sampleTicks[level * capacity + slot] = tick;
+		++pushed[level];
+
+		if (level + 1ull == levels)
+			return;
+
+		float* accumulator = &accumulators[level * width];
+		for (size_t i = 0ull; i < width; ++i)
+		{
+			accumulator[i] += sample[i];
+		}
+		if (++accumulated[level] < factor)
+			return;
+
+		for (size_t i = 0ull; i < width; ++i)
+		{
+			accumulator[i] /= factor;
+		}
+		push(level + 1ull, accumulator, tick);
+		std::fill(accumulator, accumulator + width, 0.0f);
+		accumulated[level] = 0ull;
+	}
+
+	size_t PopulationHistory::getSampleCount(size_t level) const
+	{
+		return static_cast<size_t>(std::min<uint64_t>(pushed[level], capacity));
+	}
+
+	uint64_t PopulationHistory::getSampleSpan(size_t level) const
+	{
+		uint64_t span = 1ull;
+		for (size_t i = 0ull; i < level; ++i)
+		{
+			span *= factor;
+		}
+		return span;
+	}
+
+	uint64_t PopulationHistory::getSampleTick(size_t level, size_t age) const
+	{
+		size_t slot = (pushed[level] - 1ull - age) % capacity;
+		return sampleTicks[level * capacity + slot];
+	}
+
+	const float* PopulationHistory::getSample(size_t level, size_t age) const
+	{
+		size_t slot = (pushed[level] - 1ull - age) % capacity;
+		return &samples[(level * capacity + slot) * getSampleWidth()];
+	}
+
+	void PopulationHistory::writeCSV(std::ostream& out) const
+	{
+		out << "level,tick,ticks_per_sample";
+		for (uint8_t type = 0u; type < types; ++type)
+		{
+			out << ",population_" << static_cast<int>(type);
+		}
+		out << ",conversions_per_second,tick_time_ms\n";
+
+		for (size_t level = 0ull; level < levels; ++level)
+		{
+			for (size_t age = getSampleCount(level); age > 0ull; --age)
+			{
+				const float* sample = getSample(level, age - 1ull);
+				out << level << ',' << getSampleTick(level, age - 1ull) << ',' << getSampleSpan(level);
+				for (uint8_t type = 0u; type < types; ++type)
+				{
+					out << ',' << sample[type];
+				}
+				out << ',' << sample[types] << ',' << sample[types + 1ull] * 1000.0f << '\n';
+			}
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+
+namespace rps
+{
+	// Fixed-memory time series of per-type population, conversion rate and tick time.
+	// Level 0 keeps the last `capacity` ticks; every `factor` samples of a level are averaged
+	// into one sample of the next, so level L covers capacity * factor^L recorded ticks.
+	// Every sample keeps the simulation tick it ends on, since ticks skipped or restored from a snapshot
+	// make that differ from the number of samples recorded.
+	// All storage is allocated by configure(); record() never allocates.
+	class PopulationHistory
+	{
+	public:
+		void configure(uint8_t types, size_t capacity, size_t levels, size_t factor);
+		void clear();
+
+		void record(uint64_t tick, const float* population, float conversionRate, float tickTime);
+
+		uint8_t getTypes() const { return types; }
+		size_t getLevels() const { return levels; }
+		size_t getCapacity() const { return capacity; }
+		size_t getFactor() const { return factor; }
+		size_t getSampleWidth() const { return types + 2ull; }
+		size_t getSampleCount(size_t level) const;
+		uint64_t getSampleSpan(size_t level) const;
+		uint64_t getSampleTick(size_t level, size_t age) const;
+
+		// age 0 is the newest sample of the level; layout is populations, conversion rate, tick time
+		const float* getSample(size_t level, size_t age) const;
+
+		void writeCSV(std::ostream&) const;
+
+	private:
+		uint8_t types = 0u;
+		size_t capacity = 0ull;
+		size_t levels = 0ull;
+		size_t factor = 1ull;
+
+		std::vector<float> samples;
+		std::vector<uint64_t> sampleTicks;
+		std::vector<float> accumulators;
+		std::vector<size_t> accumulated;
+		std::vector<uint64_t> pushed;
+		std::vector<float> scratch;
+
+		void push(size_t level, const float* sample, uint64_t tick);
+	};
+}
@@ -0,0 +1,107 @@
+#include "QualityGovernor.hpp"
+
+#include <algorithm>
+
+
+namespace rps
+{
+	void QualityGovernor::configure(const GovernorConfig& newConfig, float newTargetFrameTime)
+	{
+		config = newConfig;
+		targetFrameTime = newTargetFrameTime;
+		averageFrameTime = newTargetFrameTime;
+		timeSinceAdjust = 0.0f;
+		resetLevels();
+	}
+
+	void QualityGovernor::setEnabled(bool isEnabled)
+	{
+		enabled = isEnabled;
+		timeSinceAdjust = 0.0f;
+		if (!enabled)
+		{
+			resetLevels();
+			lastDecision = "disabled";
+		}
+	}
+
+	void QualityGovernor::resetLevels()
+	{
+		levels.retargetInterval = config.minRetargetInterval;
+		levels.renderLOD = config.minRenderLOD;
+		levels.soundVoices = config.maxSoundVoices;
+	}
+
+	float QualityGovernor::getSimulationStep(float deltaTime) const
+	{
+		if (!enabled)
+			return deltaTime;
+		return std::min(deltaTime, config.maxSimulationStep);
+	}
+
+	bool QualityGovernor::update(float frameTime, float deltaTime)
+	{
+		averageFrameTime += (frameTime - averageFrameTime) * config.smoothing;
+		if (!enabled)
+			return false;
+
+		timeSinceAdjust += deltaTime;
+		if (timeSinceAdjust < config.adjustInterval)
+			return false;
+		timeSinceAdjust = 0.0f;
+
+		if (averageFrameTime > targetFrameTime)
+			return degrade();
+		if (averageFrameTime < targetFrameTime * config.headroom)
+			return improve();
+		return false;
+	}
+
+	bool QualityGovernor::degrade()
+	{
+		if (levels.renderLOD < config.maxRenderLOD)
+		{
+			++levels.renderLOD;
+			lastDecision = "LOD +";
+			return true;
+		}
+		if (levels.retargetInterval < config.maxRetargetInterval)
+		{
+			levels.retargetInterval = std::min(levels.retargetInterval * 2u, config.maxRetargetInterval);
+			lastDecision = "retarget +";
+			return true;
+		}
+		if (levels.soundVoices > config.minSoundVoices)
+		{
+			levels.soundVoices = std::max(levels.soundVoices / SOUND_VOICE_STEP, config.minSoundVoices);
+			lastDecision = "voices -";
+			return true;
+		}
+		lastDecision = "at minimum";
+		return false;
+	}
+
+	bool QualityGovernor::improve()
+	{
+		if (levels.soundVoices < config.maxSoundVoices)
+		{
+			levels.soundVoices = std::min(levels.soundVoices * SOUND_VOICE_STEP, config.maxSoundVoices);
+			lastDecision = "voices +";
+			return true;
+		}
+		if (levels.retargetInterval > config.minRetargetInterval)
+		{
+			levels.retargetInterval = std::max(levels.retargetInterval / 2u, config.minRetargetInterval);
+			lastDecision = "retarget -";
+			return true;
+		}
+		if (levels.renderLOD > config.minRenderLOD)
+		{
+			--levels.renderLOD;
+			lastDecision = "LOD -";
+			return true;
+		}
+		lastDecision = "at maximum";
+		return false;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+#define SOUND_VOICE_STEP 8u
+
+
+namespace rps
+{
+	struct GovernorConfig
+	{
+		float adjustInterval = 0.5f;
+		float smoothing = 0.1f;
+		float headroom = 0.7f;
+		float maxSimulationStep = 1.0f / 30.0f;
+
+		size_t minRetargetInterval = 1ull;
+		size_t maxRetargetInterval = 8ull;
+		uint8_t minRenderLOD = 0u;
+		uint8_t maxRenderLOD = 2u;
+		size_t minSoundVoices = 16ull;
+		size_t maxSoundVoices = 140ull;
+	};
+
+
+	struct QualityLevels
+	{
+		size_t retargetInterval;
+		uint8_t renderLOD;
+		size_t soundVoices;
+	};
+
+
+	// Watches the frame time against a target and trades quality for speed one knob at a time.
+	// Knobs are lowered in the order render LOD, retarget interval, sound voices and restored in reverse,
+	// so the ones that save the most main-thread time go first. Voices are mixed on the audio thread
+	// and are cut SOUND_VOICE_STEP-fold at a time. Antialiasing is left to the user:
+	// changing it recreates the window, which is a frame spike of its own.
+	class QualityGovernor
+	{
+	public:
+		void configure(const GovernorConfig&, float targetFrameTime);
+		void setEnabled(bool);
+
+		bool update(float frameTime, float deltaTime);
+
+		bool isEnabled() const { return enabled; }
+		const QualityLevels& getLevels() const { return levels; }
+		float getAverageFrameTime() const { return averageFrameTime; }
+		float getTargetFrameTime() const { return targetFrameTime; }
+		float getSimulationStep(float deltaTime) const;
+		const char* getLastDecision() const { return lastDecision; }
+
+	private:
+		GovernorConfig config;
+		QualityLevels levels;
+		bool enabled = true;
+
+		float targetFrameTime = 1.0f / 60.0f;
+		float averageFrameTime = 0.0f;
+		float timeSinceAdjust = 0.0f;
+		const char* lastDecision = "-";
+
+		void resetLevels();
+		bool degrade();
+		bool improve();
+	};
+}
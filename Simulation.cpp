@@ -0,0 +1,595 @@
+#include "Simulation.hpp"
+#include "Tracer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+static_assert(MAX_TYPES <= SNAPSHOT_MAX_TYPES, "Snapshot header has no room for every type");
+
+
+namespace rps
+{
+	void Simulation::configure(const SimulationConfig& newConfig, uint32_t seed)
+	{
+		config = newConfig;
+		random.seed(seed);
+
+		positions.assign(config.types, std::vector<sf::Vector2f>());
+		alive.assign(config.types, std::vector<uint8_t>());
+		counts.assign(config.types, 0ull);
+		nearestVictims.resize(config.types);
+		nearestHunters.resize(config.types);
+		searchedCounts.assign(config.types, 0ull);
+		grids.resize(config.types);
+		flowFields.resize(config.types);
+		clear();
+	}
+
+	void Simulation::setSpeed(float speed)
+	{
+		config.speed = speed;
+	}
+
+	void Simulation::setSize(float size)
+	{
+		config.size = size;
+	}
+
+	void Simulation::setCount(size_t count)
+	{
+		config.count = count;
+	}
+
+	void Simulation::setFlowField(bool isFlowField)
+	{
+		config.isFlowField = isFlowField;
+		invalidateTargets();
+	}
+
+	void Simulation::setRetargetInterval(size_t interval)
+	{
+		retargetInterval = interval;
+	}
+
+	void Simulation::setConversionBus(ConversionBus* bus)
+	{
+		conversionBus = bus;
+	}
+
+	void Simulation::setJobSystem(JobSystem* jobSystem)
+	{
+		jobs = jobSystem;
+	}
+
+// --------------------------------Objects--------------------------------
+
+	// Touches nothing but its arguments, so a match can be generated on a worker thread
+	std::vector<std::vector<sf::Vector2f>> Simulation::generateObjects(const SimulationConfig& config, const PlacementConfig& placement, uint32_t seed, JobSystem* jobs)
+	{
+		TRACE_SCOPE("generateObjects");
+		std::vector<std::vector<sf::Vector2f>> generated(config.types);
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			generated[type].resize(config.count);
+			size_t placed = placeObjects(generated[type].data(), config.count, type, config.types, config.worldSize, placement, (static_cast<uint64_t>(seed) << 8) | type, jobs);
+			generated[type].resize(placed);
+		}
+		return generated;
+	}
+
+	uint32_t Simulation::getNextSeed()
+	{
+		return static_cast<uint32_t>(random());
+	}
+
+	void Simulation::clear()
+	{
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			positions[type].clear();
+			alive[type].clear();
+			counts[type] = 0ull;
+		}
+		tick = 0ull;
+		tickConversions = 0ull;
+		++layoutVersion;
+		invalidateTargets();
+	}
+
+	// Takes the arrays over when a type is empty, which is the case after clear()
+	void Simulation::insertObjects(std::vector<std::vector<sf::Vector2f>> inserted)
+	{
+		for (uint8_t type = ROCK; type < std::min(config.types, static_cast<uint8_t>(inserted.size())); ++type)
+		{
+			counts[type] += inserted[type].size();
+			if (positions[type].empty())
+				positions[type].swap(inserted[type]);
+			else
+				positions[type].insert(positions[type].end(), inserted[type].begin(), inserted[type].end());
+			alive[type].resize(positions[type].size(), 1u);
+		}
+		reserveObjects();
+		++layoutVersion;
+		invalidateTargets();
+	}
+
+	void Simulation::addObject(uint8_t type)
+	{
+		sf::Vector2f pos(static_cast<float>(random() % static_cast<unsigned int>(config.worldSize.x)), static_cast<float>(random() % static_cast<unsigned int>(config.worldSize.y)));
+		positions[type].push_back(pos);
+		alive[type].push_back(1u);
+		++counts[type];
+		reserveObjects();
+	}
+
+	void Simulation::deleteObject(uint8_t type)
+	{
+		if (counts[type] == 0ull)
+			return;
+		compact();
+		++layoutVersion;
+		invalidateTargets();
+		size_t randomIndex = random() % positions[type].size();
+		positions[type].erase(positions[type].begin() + randomIndex);
+		alive[type].pop_back();
+		--counts[type];
+	}
+
+	// The batch is placed straight into the grown tail of the array: one resize, no per-object work outside placement
+	size_t Simulation::spawnObjects(uint8_t type, size_t count, const PlacementConfig& placement)
+	{
+		TRACE_SCOPE("spawnObjects");
+		size_t first = positions[type].size();
+		positions[type].resize(first + count);
+		size_t placed = placeObjects(positions[type].data() + first, count, type, config.types, config.worldSize, placement, (static_cast<uint64_t>(getNextSeed()) << 8) | type, jobs);
+		positions[type].resize(first + placed);
+		alive[type].resize(first + placed, 1u);
+		counts[type] += placed;
+		reserveObjects();
+		return placed;
+	}
+
+	// Selection sampling: each object is removed with probability (still to remove) / (still to visit),
+	// which removes exactly `count` uniformly at random in one stable pass
+	size_t Simulation::despawnObjects(uint8_t type, size_t count)
+	{
+		TRACE_SCOPE("despawnObjects");
+		compact();
+		++layoutVersion;
+		invalidateTargets();
+
+		size_t total = positions[type].size();
+		count = std::min(count, total);
+		size_t remove = count;
+		size_t kept = 0ull;
+		for (size_t i = 0ull; i < total; ++i)
+		{
+			if (remove != 0ull && random() % (total - i) < remove)
+			{
+				--remove;
+				continue;
+			}
+			positions[type][kept++] = positions[type][i];
+		}
+		positions[type].resize(kept);
+		alive[type].resize(kept);
+		counts[type] = kept;
+		return count;
+	}
+
+	void Simulation::compact()
+	{
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			if (counts[type] == positions[type].size())
+				continue;
+			size_t kept = 0ull;
+			for (size_t i = 0ull; i < positions[type].size(); ++i)
+			{
+				if (alive[type][i])
+					positions[type][kept++] = positions[type][i];
+			}
+			positions[type].resize(kept);
+			alive[type].assign(kept, 1u);
+			++layoutVersion;
+		}
+	}
+
+	// Tombstones are left in place until they make up a quarter of a type's array, or until the type could
+	// outgrow the room reserved for it within a tick, so most ticks keep indices and grids built on them valid
+	void Simulation::compactIfCrowded()
+	{
+		size_t total = 0ull;
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			total += counts[type];
+		}
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			size_t tombstones = positions[type].size() - counts[type];
+			if (tombstones * 4ull > positions[type].size() || tombstones + total > positions[type].capacity())
+			{
+				compact();
+				return;
+			}
+		}
+	}
+
+	// Conversions only move objects between types, so once every type has room for all of them, plus a quarter
+	// for tombstones, the arrays and grids stop growing in step(), save for tombstones kept between flow field
+	// rebuilds. Grows at least twofold, so adding objects one at a time stays amortized.
+	void Simulation::reserveObjects()
+	{
+		size_t total = 0ull;
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			total += positions[type].size();
+		}
+		size_t reserved = total + total / 4ull;
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			if (positions[type].capacity() >= reserved)
+				continue;
+			size_t capacity = std::max(reserved, positions[type].capacity() * static_cast<size_t>(2ull));
+			positions[type].reserve(capacity);
+			alive[type].reserve(capacity);
+			grids[type].reserve(capacity);
+		}
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			nearestVictims[type].reserve(reserved);
+			nearestHunters[type].reserve(reserved);
+		}
+	}
+
+	inline void Simulation::invalidateTargets()
+	{
+		retargetAge = SIZE_MAX;
+	}
+
+// --------------------------------Useful Functions--------------------------------
+
+	sf::Vector2f getNormalized(const sf::Vector2f& v)
+	{
+		float mag = std::sqrtf(v.x * v.x + v.y * v.y);
+		return sf::Vector2f(v.x / mag, v.y / mag);
+	}
+
+	inline sf::Vector2f getScaled(const sf::Vector2f& v, float scale)
+	{
+		return sf::Vector2f(v.x * scale, v.y * scale);
+	}
+
+	inline sf::Vector2f getDistance(const sf::Vector2f& a, const sf::Vector2f& b)
+	{
+		return sf::Vector2f(b.x - a.x, b.y - a.y);
+	}
+
+	inline float getSqrMagnitude(const sf::Vector2f& v)
+	{
+		return v.x * v.x + v.y * v.y;
+	}
+
+	inline void moveTo(sf::Vector2f& object, const sf::Vector2f& pos, float distance)
+	{
+		object += getScaled(getNormalized(getDistance(object, pos)), distance);
+	}
+
+	size_t Simulation::getNearestObject(const sf::Vector2f& myPos, uint8_t type) const
+	{
+		const std::vector<sf::Vector2f>& victims = positions[type];
+		size_t nearestVictim = SIZE_MAX;
+		float nearestDistSqrMag = 0.0f;
+		for (size_t i = 0ull; i < victims.size(); ++i)
+		{
+			if (!alive[type][i])
+				continue;
+			float distSqrMag = getSqrMagnitude(getDistance(myPos, victims[i]));
+			if (nearestVictim == SIZE_MAX || distSqrMag < nearestDistSqrMag)
+			{
+				nearestVictim = i;
+				nearestDistSqrMag = distSqrMag;
+			}
+		}
+		return nearestVictim;
+	}
+
+	// Sized so an average type has about FLOW_OBJECTS_PER_CELL objects per cell, which keeps the cell count
+	// a fixed fraction of the object count whatever the world size. Never below flowCellSize or the touch
+	// distance the 3x3 search has to cover. Conversions keep the total, so cells stay the same size
+	// and the grids stop allocating until objects are spawned or removed.
+	float Simulation::getFlowCellSize() const
+	{
+		size_t total = 0ull;
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			total += counts[type];
+		}
+		if (total == 0ull)
+			return std::max(config.worldSize.x, config.worldSize.y);
+		float densitySize = std::sqrt(config.worldSize.x * config.worldSize.y * config.types * FLOW_OBJECTS_PER_CELL / total);
+		return std::max(densitySize, std::max(config.flowCellSize, config.size / 2.0f));
+	}
+
+	inline bool Simulation::isTouching(const sf::Vector2f& object, const sf::Vector2f& pos) const
+	{
+		float halfSize = config.size / 2.0f;
+		return sf::FloatRect(object.x - halfSize, object.y - halfSize, config.size, config.size).contains(pos);
+	}
+
+	inline void Simulation::clampObject(sf::Vector2f& object) const
+	{
+		object.x = std::fmax(std::fmin(object.x, config.worldSize.x - config.size), config.size);
+		object.y = std::fmax(std::fmin(object.y, config.worldSize.y - config.size), config.size);
+	}
+
+// --------------------------------Update--------------------------------
+
+	void Simulation::step(float timeStep)
+	{
+		tickConversions = 0ull;
+		if (config.isFlowField)
+		{
+			updateObjectsByFlowField(timeStep);
+		}
+		else
+		{
+			compactIfCrowded();
+			updateObjects(timeStep);
+		}
+		++tick;
+	}
+
+	// Ids in the event are the hunter's and victim's slots within their types at the moment of conversion
+	void Simulation::convertObject(uint8_t type, size_t hunterIndex, uint8_t victimType, size_t victimIndex)
+	{
+		sf::Vector2f pos = positions[victimType][victimIndex];
+		alive[victimType][victimIndex] = 0u;
+		--counts[victimType];
+		positions[type].push_back(pos);
+		alive[type].push_back(1u);
+		++counts[type];
+		++tickConversions;
+
+		if (conversionBus != nullptr)
+			conversionBus->publish(ConversionEvent{ tick, static_cast<uint32_t>(hunterIndex), static_cast<uint32_t>(victimIndex), type, victimType, pos.x, pos.y });
+	}
+
+	// Nearest targets of a type are searched for in parallel first, reading nothing that changes meanwhile;
+	// moves and conversions are then applied in order. Conversions only kill victims and append to this type,
+	// so a target found up front is still the nearest one unless it was converted since, and objects
+	// converted during the pass search on their own. Hunters are searched from where an object started the tick.
+	// Targets are kept for retargetInterval ticks while indices stay valid, converted ones are still replaced.
+	// Conversions append to the hunter's array, so positions are re-read by index instead of held by reference.
+	void Simulation::updateObjects(float timeStep)
+	{
+		bool isRetarget = retargetAge >= retargetInterval || targetLayout != layoutVersion;
+		if (isRetarget)
+		{
+			retargetAge = 0ull;
+			targetLayout = layoutVersion;
+		}
+		++retargetAge;
+
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			uint8_t victimType = (type + config.types - 1u) % config.types;
+			uint8_t hunterType = (type + 1u) % config.types;
+			std::vector<size_t>& victims = nearestVictims[type];
+			std::vector<size_t>& hunters = nearestHunters[type];
+
+			if (isRetarget)
+			{
+				searchedCounts[type] = positions[type].size();
+				victims.resize(searchedCounts[type]);
+				hunters.resize(searchedCounts[type]);
+				auto search = [&](size_t first, size_t last)
+				{
+					for (size_t i = first; i < last; ++i)
+					{
+						if (!alive[type][i])
+							continue;
+						victims[i] = counts[victimType] != 0ull ? getNearestObject(positions[type][i], victimType) : SIZE_MAX;
+						hunters[i] = counts[hunterType] != 0ull ? getNearestObject(positions[type][i], hunterType) : SIZE_MAX;
+					}
+				};
+				if (jobs != nullptr)
+					jobs->parallelFor(searchedCounts[type], STEERING_GRAIN, search);
+				else
+					search(0ull, searchedCounts[type]);
+			}
+			size_t searched = searchedCounts[type];
+
+			for (size_t i = 0ull; i < positions[type].size(); ++i)
+			{
+				if (!alive[type][i])
+					continue;
+				if (counts[victimType] != 0ull)
+				{
+					size_t nearestVictim = i < searched ? victims[i] : SIZE_MAX;
+					if (nearestVictim == SIZE_MAX || !alive[victimType][nearestVictim])
+						nearestVictim = getNearestObject(positions[type][i], victimType);
+					sf::Vector2f victimPos = positions[victimType][nearestVictim];
+					moveTo(positions[type][i], victimPos, config.speed * timeStep);
+
+					if (isTouching(positions[type][i], victimPos))
+					{
+						convertObject(type, i, victimType, nearestVictim);
+					}
+				}
+				if (counts[hunterType] != 0ull)
+				{
+					size_t nearestHunter = i < searched ? hunters[i] : SIZE_MAX;
+					if (nearestHunter == SIZE_MAX || !alive[hunterType][nearestHunter])
+						nearestHunter = getNearestObject(positions[type][i], hunterType);
+					moveTo(positions[type][i], positions[hunterType][nearestHunter], -config.speed * 0.5f * timeStep);
+				}
+				clampObject(positions[type][i]);
+			}
+		}
+	}
+
+	void Simulation::updateObjectsByFlowField(float timeStep)
+	{
+		if (retargetAge >= retargetInterval)
+		{
+			compactIfCrowded();
+			float cellSize = getFlowCellSize();
+			auto rebuild = [&](size_t firstType, size_t lastType)
+			{
+				for (size_t type = firstType; type < lastType; ++type)
+				{
+					grids[type].resize(config.worldSize, cellSize);
+					grids[type].build(positions[type], alive[type]);
+					flowFields[type].build(grids[type]);
+				}
+			};
+			if (jobs != nullptr)
+				jobs->parallelFor(config.types, 1ull, rebuild);
+			else
+				rebuild(0ull, config.types);
+			retargetAge = 0ull;
+		}
+		++retargetAge;
+
+		// Fields and grids describe the tick they were built on: a victim converted since
+		// is still in its old type's grid as a tombstone, so conversions re-check it is alive.
+		// Within a cell of the nearest source the grid is searched instead, over at most
+		// FLOW_NEAREST_CANDIDATES objects: exact while cells are sparse, approximate in crowded ones.
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			uint8_t victimType = (type + config.types - 1u) % config.types;
+			uint8_t hunterType = (type + 1u) % config.types;
+
+			for (size_t i = 0ull; i < positions[type].size(); ++i)
+			{
+				if (!alive[type][i])
+					continue;
+				if (counts[victimType] != 0ull && !grids[victimType].isEmpty())
+				{
+					sf::Vector2f myPos = positions[type][i];
+					size_t nearestVictim = SIZE_MAX;
+					if (flowFields[victimType].getDistance(myPos) <= grids[victimType].getCellSize())
+						nearestVictim = grids[victimType].getNearestObject(myPos, FLOW_NEAREST_CANDIDATES);
+
+					if (nearestVictim == SIZE_MAX)
+					{
+						moveTo(positions[type][i], flowFields[victimType].getNearestSource(myPos), config.speed * timeStep);
+					}
+					else
+					{
+						sf::Vector2f victimPos = positions[victimType][nearestVictim];
+						moveTo(positions[type][i], victimPos, config.speed * timeStep);
+
+						if (alive[victimType][nearestVictim] && isTouching(positions[type][i], victimPos))
+							convertObject(type, i, victimType, nearestVictim);
+					}
+				}
+				if (counts[hunterType] != 0ull && !grids[hunterType].isEmpty())
+				{
+					sf::Vector2f myPos = positions[type][i];
+					size_t nearestHunter = SIZE_MAX;
+					if (flowFields[hunterType].getDistance(myPos) <= grids[hunterType].getCellSize())
+						nearestHunter = grids[hunterType].getNearestObject(myPos, FLOW_NEAREST_CANDIDATES);
+
+					if (nearestHunter == SIZE_MAX)
+						positions[type][i] += getScaled(flowFields[hunterType].getGradient(myPos), config.speed * 0.5f * timeStep);
+					else
+						moveTo(positions[type][i], positions[hunterType][nearestHunter], -config.speed * 0.5f * timeStep);
+				}
+				clampObject(positions[type][i]);
+			}
+		}
+	}
+
+// --------------------------------Snapshots--------------------------------
+
+	// Tombstones are skipped, so a snapshot always holds compacted arrays
+	void Simulation::saveSnapshot(std::vector<char>& buffer) const
+	{
+		TRACE_SCOPE("saveSnapshot");
+		std::ostringstream randomStream;
+		randomStream << random;
+		std::string randomState = randomStream.str();
+
+		SnapshotHeader header = {};
+		header.magic = SNAPSHOT_MAGIC;
+		header.version = SNAPSHOT_VERSION;
+		header.tick = tick;
+		header.count = config.count;
+		header.speed = config.speed;
+		header.size = config.size;
+		header.worldWidth = config.worldSize.x;
+		header.worldHeight = config.worldSize.y;
+		header.flowCellSize = config.flowCellSize;
+		header.types = config.types;
+		header.isFlowField = config.isFlowField ? 1u : 0u;
+
+		uint64_t offset = sizeof(SnapshotHeader);
+		header.randomOffset = offset;
+		header.randomSize = randomState.size();
+		offset = (offset + randomState.size() + 7ull) & ~7ull;
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			header.objectOffsets[type] = offset;
+			header.objectCounts[type] = counts[type];
+			offset += counts[type] * sizeof(sf::Vector2f);
+		}
+		header.fileSize = offset;
+
+		buffer.assign(static_cast<size_t>(offset), 0);
+		std::memcpy(buffer.data() + header.randomOffset, randomState.data(), randomState.size());
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			char* target = buffer.data() + header.objectOffsets[type];
+			for (size_t i = 0ull; i < positions[type].size(); ++i)
+			{
+				if (!alive[type][i])
+					continue;
+				std::memcpy(target, &positions[type][i], sizeof(sf::Vector2f));
+				target += sizeof(sf::Vector2f);
+			}
+		}
+
+		header.checksum = getSnapshotChecksum(buffer.data() + sizeof(SnapshotHeader), buffer.size() - sizeof(SnapshotHeader));
+		std::memcpy(buffer.data(), &header, sizeof(SnapshotHeader));
+	}
+
+	// The PRNG is restored after configure(), so the seed passed there is irrelevant
+	bool Simulation::loadSnapshot(const SnapshotFile& file)
+	{
+		TRACE_SCOPE("loadSnapshot");
+		const SnapshotHeader& header = file.getHeader();
+		if (header.types > MAX_TYPES)
+			return false;
+
+		std::istringstream randomStream(file.getRandomState());
+		std::mt19937 loadedRandom;
+		if (!(randomStream >> loadedRandom))
+			return false;
+
+		SimulationConfig loaded;
+		loaded.types = header.types;
+		loaded.count = static_cast<size_t>(header.count);
+		loaded.speed = header.speed;
+		loaded.size = header.size;
+		loaded.worldSize = sf::Vector2f(header.worldWidth, header.worldHeight);
+		loaded.isFlowField = header.isFlowField != 0u;
+		loaded.flowCellSize = header.flowCellSize;
+		configure(loaded, 0u);
+
+		random = loadedRandom;
+		tick = header.tick;
+		for (uint8_t type = ROCK; type < config.types; ++type)
+		{
+			const sf::Vector2f* first = file.getPositions(type);
+			positions[type].assign(first, first + header.objectCounts[type]);
+			alive[type].assign(positions[type].size(), 1u);
+			counts[type] = positions[type].size();
+		}
+		reserveObjects();
+		return true;
+	}
+}
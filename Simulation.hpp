@@ -0,0 +1,118 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+
+#include "FlowField.hpp"
+#include "ConversionBus.hpp"
+#include "Snapshot.hpp"
+#include "Placement.hpp"
+
+#include <vector>
+#include <random>
+#include <cstdint>
+
+#define MAX_TYPES 3u
+#define ROCK 0u
+#define PAPER 1u
+#define SCISSORS 2u
+#define FLOW_OBJECTS_PER_CELL 4.0f
+#define FLOW_NEAREST_CANDIDATES 32ull
+#define STEERING_GRAIN 64ull
+
+
+namespace rps
+{
+	struct SimulationConfig
+	{
+		uint8_t types = 3u;
+		size_t count = 32ull;
+		float speed = 64.0f;
+		float size = 32.0f;
+		sf::Vector2f worldSize = sf::Vector2f(720.0f, 720.0f);
+
+		bool isFlowField = false;
+		// Smallest flow field cell; cells grow as objects get sparser
+		float flowCellSize = 16.0f;
+	};
+
+
+	// Full state of one match: settings, PRNG, tick and every object's position, kept per type
+	// in plain arrays. A converted object leaves a tombstone in its old type that is only compacted
+	// away once tombstones crowd the arrays and no spatial grid refers to them, so indices stay valid
+	// across most ticks and always between grid rebuilds.
+	// Needs no window, textures or audio, so it also runs headless.
+	class Simulation
+	{
+	public:
+		void configure(const SimulationConfig&, uint32_t seed);
+		const SimulationConfig& getConfig() const { return config; }
+
+		void setSpeed(float);
+		void setSize(float);
+		void setCount(size_t);
+		void setFlowField(bool);
+		void setRetargetInterval(size_t);
+		void setConversionBus(ConversionBus*);
+		void setJobSystem(JobSystem*);
+
+		static std::vector<std::vector<sf::Vector2f>> generateObjects(const SimulationConfig&, const PlacementConfig&, uint32_t seed, JobSystem*);
+		uint32_t getNextSeed();
+
+		void clear();
+		void insertObjects(std::vector<std::vector<sf::Vector2f>>);
+		void addObject(uint8_t);
+		void deleteObject(uint8_t);
+		size_t spawnObjects(uint8_t, size_t count, const PlacementConfig&);
+		size_t despawnObjects(uint8_t, size_t count);
+
+		void step(float timeStep);
+
+		uint64_t getTick() const { return tick; }
+		size_t getTickConversions() const { return tickConversions; }
+		size_t getCount(uint8_t type) const { return counts[type]; }
+		// Changes whenever objects are removed or reordered; objects appended since keep their indices
+		uint64_t getLayoutVersion() const { return layoutVersion; }
+		const std::vector<sf::Vector2f>& getPositions(uint8_t type) const { return positions[type]; }
+		const std::vector<uint8_t>& getAliveFlags(uint8_t type) const { return alive[type]; }
+		bool isAlive(uint8_t type, size_t index) const { return alive[type][index] != 0u; }
+
+		void saveSnapshot(std::vector<char>&) const;
+		bool loadSnapshot(const SnapshotFile&);
+
+	private:
+		SimulationConfig config;
+		std::mt19937 random;
+		uint64_t tick = 0ull;
+		uint64_t layoutVersion = 0ull;
+		size_t tickConversions = 0ull;
+		ConversionBus* conversionBus = nullptr;
+		JobSystem* jobs = nullptr;
+
+		std::vector<std::vector<sf::Vector2f>> positions;
+		std::vector<std::vector<uint8_t>> alive;
+		std::vector<size_t> counts;
+
+		std::vector<std::vector<size_t>> nearestVictims;
+		std::vector<std::vector<size_t>> nearestHunters;
+		std::vector<size_t> searchedCounts;
+		uint64_t targetLayout = 0ull;
+
+		std::vector<SpatialGrid> grids;
+		std::vector<FlowField> flowFields;
+		size_t retargetAge = SIZE_MAX;
+		size_t retargetInterval = 1ull;
+
+		void compact();
+		void compactIfCrowded();
+		void reserveObjects();
+		inline void invalidateTargets();
+
+		void updateObjects(float);
+		void updateObjectsByFlowField(float);
+		void convertObject(uint8_t, size_t, uint8_t, size_t);
+
+		size_t getNearestObject(const sf::Vector2f&, uint8_t) const;
+		float getFlowCellSize() const;
+		inline bool isTouching(const sf::Vector2f&, const sf::Vector2f&) const;
+		inline void clampObject(sf::Vector2f&) const;
+	};
+}
@@ -0,0 +1,142 @@
+#include "Snapshot.hpp"
+
+#include <Windows.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+
+namespace rps
+{
+	// FNV-1a over 8-byte words, with the tail folded in bytewise
+	uint64_t getSnapshotChecksum(const char* data, size_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		size_t i = 0ull;
+		for (; i + 8ull <= size; i += 8ull)
+		{
+			uint64_t word;
+			std::memcpy(&word, data + i, 8ull);
+			hash = (hash ^ word) * 1099511628211ull;
+		}
+		for (; i < size; ++i)
+		{
+			hash = (hash ^ static_cast<uint8_t>(data[i])) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	SnapshotFile::~SnapshotFile()
+	{
+		close();
+	}
+
+	bool SnapshotFile::open(const std::string& fileName)
+	{
+		close();
+
+		file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			file = nullptr;
+			std::cout << "Failed to open " << fileName << std::endl;
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < static_cast<long long>(sizeof(SnapshotHeader)))
+		{
+			std::cout << fileName << " is not a snapshot" << std::endl;
+			close();
+			return false;
+		}
+		size = static_cast<uint64_t>(fileSize.QuadPart);
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr)
+			view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (view == nullptr)
+		{
+			std::cout << "Failed to map " << fileName << std::endl;
+			close();
+			return false;
+		}
+
+		if (!validate(fileName))
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void SnapshotFile::close()
+	{
+		if (view != nullptr)
+			UnmapViewOfFile(view);
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		if (file != nullptr)
+			CloseHandle(file);
+		view = nullptr;
+		mapping = nullptr;
+		file = nullptr;
+		size = 0ull;
+	}
+
+	bool SnapshotFile::validate(const std::string& fileName) const
+	{
+		const SnapshotHeader& header = getHeader();
+		if (header.magic != SNAPSHOT_MAGIC)
+		{
+			std::cout << fileName << " is not a snapshot" << std::endl;
+			return false;
+		}
+		if (header.version != SNAPSHOT_VERSION)
+		{
+			std::cout << fileName << " has snapshot version " << header.version << ", expected " << SNAPSHOT_VERSION << std::endl;
+			return false;
+		}
+
+		bool isValid = header.fileSize == size && header.types != 0u && header.types <= SNAPSHOT_MAX_TYPES
+			&& header.randomOffset <= size && header.randomSize <= size - header.randomOffset;
+		for (uint8_t type = 0u; isValid && type < header.types; ++type)
+		{
+			uint64_t offset = header.objectOffsets[type];
+			isValid = offset % 8ull == 0ull && offset <= size && header.objectCounts[type] <= (size - offset) / sizeof(sf::Vector2f);
+		}
+		if (!isValid)
+		{
+			std::cout << fileName << " is truncated or corrupted" << std::endl;
+			return false;
+		}
+
+		if (getSnapshotChecksum(view + sizeof(SnapshotHeader), size - sizeof(SnapshotHeader)) != header.checksum)
+		{
+			std::cout << fileName << " failed the checksum" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	std::string SnapshotFile::getRandomState() const
+	{
+		return std::string(view + getHeader().randomOffset, getHeader().randomSize);
+	}
+
+	const sf::Vector2f* SnapshotFile::getPositions(uint8_t type) const
+	{
+		return reinterpret_cast<const sf::Vector2f*>(view + getHeader().objectOffsets[type]);
+	}
+
+	bool SnapshotFile::write(const std::string& fileName, const std::vector<char>& buffer)
+	{
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		if (!file.write(buffer.data(), buffer.size()))
+		{
+			std::cout << "Failed to write " << fileName << std::endl;
+			return false;
+		}
+		return true;
+	}
+}
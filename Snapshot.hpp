@@ -0,0 +1,75 @@
+#pragma once
+#include <SFML/System.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SNAPSHOT_MAGIC 0x53535052u
+#define SNAPSHOT_VERSION 1u
+#define SNAPSHOT_MAX_TYPES 8u
+
+
+namespace rps
+{
+	// Little-endian file layout: this header, the PRNG state, then one block of positions
+	// (x, y floats) per type. Blocks start at 8-byte aligned offsets so they can be used
+	// in place from a mapped view; the checksum covers everything after the header.
+	struct SnapshotHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t fileSize;
+		uint64_t checksum;
+
+		uint64_t tick;
+		uint64_t count;
+		float speed;
+		float size;
+		float worldWidth;
+		float worldHeight;
+		float flowCellSize;
+		uint8_t types;
+		uint8_t isFlowField;
+		uint8_t padding[2];
+
+		uint64_t randomOffset;
+		uint64_t randomSize;
+		uint64_t objectOffsets[SNAPSHOT_MAX_TYPES];
+		uint64_t objectCounts[SNAPSHOT_MAX_TYPES];
+	};
+	static_assert(sizeof(SnapshotHeader) == 208ull, "Snapshot header layout changed: bump SNAPSHOT_VERSION");
+
+	uint64_t getSnapshotChecksum(const char* data, size_t size);
+
+
+	// Read-only memory mapping of a validated snapshot. Nothing is parsed or copied on open:
+	// the position blocks are read straight from the mapped pages, and one mapping can be
+	// shared by any number of readers.
+	class SnapshotFile
+	{
+	public:
+		SnapshotFile() = default;
+		SnapshotFile(const SnapshotFile&) = delete;
+		SnapshotFile& operator=(const SnapshotFile&) = delete;
+		~SnapshotFile();
+
+		bool open(const std::string& fileName);
+		void close();
+		bool isOpen() const { return view != nullptr; }
+
+		const SnapshotHeader& getHeader() const { return *reinterpret_cast<const SnapshotHeader*>(view); }
+		std::string getRandomState() const;
+		const sf::Vector2f* getPositions(uint8_t type) const;
+
+		static bool write(const std::string& fileName, const std::vector<char>& buffer);
+
+	private:
+		void* file = nullptr;
+		void* mapping = nullptr;
+		const char* view = nullptr;
+		uint64_t size = 0ull;
+
+		bool validate(const std::string& fileName) const;
+	};
+}
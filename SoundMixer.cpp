@@ -0,0 +1,217 @@
+#include "SoundMixer.hpp"
+#include "AllocTracker.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RPS_MIXER_SSE
+#include <emmintrin.h>
+#endif
+
+
+namespace rps
+{
+	SoundMixer::SoundMixer()
+		: channels(2u), rate(44100u), blockFrames(0ull), voiceCount(0ull),
+		triggers(new Trigger[triggerCapacity]), triggerHead(0ull), triggerTail(0ull),
+		masterVolume(1.0f), voiceLimit(0ull), activeVoices(0ull), droppedVoices(0ull), isStopRequested(false)
+	{
+	}
+
+	SoundMixer::~SoundMixer()
+	{
+		stop();
+	}
+
+	void SoundMixer::setup(unsigned int channelCount, unsigned int sampleRate, size_t maxVoices, size_t frames)
+	{
+		channels = std::max(channelCount, 1u);
+		rate = sampleRate;
+		blockFrames = frames;
+
+		voices.resize(maxVoices);
+		voiceLimit.store(maxVoices);
+		mixBuffer.resize(blockFrames * channels);
+		outputBuffer.resize(blockFrames * channels);
+		initialize(channels, rate);
+	}
+
+	// Resamples linearly to the mixer rate and maps the clip's channels onto the mixer's
+	size_t SoundMixer::addClip(const sf::SoundBuffer& buffer)
+	{
+		const sf::Int16* source = buffer.getSamples();
+		unsigned int sourceChannels = std::max(buffer.getChannelCount(), 1u);
+		size_t sourceFrames = static_cast<size_t>(buffer.getSampleCount() / sourceChannels);
+		size_t lastFrame = sourceFrames == 0ull ? 0ull : sourceFrames - 1ull;
+		double ratio = static_cast<double>(buffer.getSampleRate()) / rate;
+
+		Clip clip;
+		clip.frames = sourceFrames == 0ull ? 0ull : static_cast<size_t>(sourceFrames / ratio);
+		clip.samples.resize(clip.frames * channels);
+		for (size_t frame = 0ull; frame < clip.frames; ++frame)
+		{
+			double position = frame * ratio;
+			size_t first = std::min(static_cast<size_t>(position), lastFrame);
+			size_t second = first < lastFrame ? first + 1ull : lastFrame;
+			float t = static_cast<float>(position - first);
+
+			for (unsigned int channel = 0u; channel < channels; ++channel)
+			{
+				float sample = 0.0f;
+				if (channels == 1u)
+				{
+					for (unsigned int sourceChannel = 0u; sourceChannel < sourceChannels; ++sourceChannel)
+					{
+						sample += source[first * sourceChannels + sourceChannel] * (1.0f - t) + source[second * sourceChannels + sourceChannel] * t;
+					}
+					sample /= sourceChannels;
+				}
+				else
+				{
+					unsigned int sourceChannel = std::min(channel, sourceChannels - 1u);
+					sample = source[first * sourceChannels + sourceChannel] * (1.0f - t) + source[second * sourceChannels + sourceChannel] * t;
+				}
+				clip.samples[frame * channels + channel] = sample / 32768.0f;
+			}
+		}
+
+		clips.push_back(std::move(clip));
+		return clips.size() - 1ull;
+	}
+
+	void SoundMixer::trigger(size_t clip, float gain)
+	{
+		size_t head = triggerHead.load(std::memory_order_relaxed);
+		if (head - triggerTail.load(std::memory_order_acquire) >= triggerCapacity)
+		{
+			droppedVoices.fetch_add(1ull, std::memory_order_relaxed);
+			return;
+		}
+		triggers[head % triggerCapacity] = Trigger{ static_cast<uint32_t>(clip), gain };
+		triggerHead.store(head + 1ull, std::memory_order_release);
+	}
+
+	void SoundMixer::stopVoices()
+	{
+		isStopRequested.store(true);
+	}
+
+	void SoundMixer::setMasterVolume(float volume)
+	{
+		masterVolume.store(volume / 100.0f, std::memory_order_relaxed);
+	}
+
+	void SoundMixer::setVoiceLimit(size_t limit)
+	{
+		voiceLimit.store(limit, std::memory_order_relaxed);
+	}
+
+	void SoundMixer::onSeek(sf::Time)
+	{
+	}
+
+// --------------------------------Streaming Thread--------------------------------
+
+	void SoundMixer::startVoices()
+	{
+		size_t limit = std::min(voiceLimit.load(std::memory_order_relaxed), voices.size());
+		size_t tail = triggerTail.load(std::memory_order_relaxed);
+		size_t head = triggerHead.load(std::memory_order_acquire);
+		for (; tail != head; ++tail)
+		{
+			const Trigger& request = triggers[tail % triggerCapacity];
+			if (voiceCount >= limit || request.clip >= clips.size())
+			{
+				droppedVoices.fetch_add(1ull, std::memory_order_relaxed);
+				continue;
+			}
+			voices[voiceCount++] = Voice{ request.clip, 0ull, request.gain };
+		}
+		triggerTail.store(tail, std::memory_order_release);
+	}
+
+	void SoundMixer::mixVoice(Voice& voice, size_t frames)
+	{
+		const Clip& clip = clips[voice.clip];
+		size_t count = std::min(frames, clip.frames - voice.frame) * channels;
+		const float* source = clip.samples.data() + voice.frame * channels;
+		float* target = mixBuffer.data();
+		size_t i = 0ull;
+
+#ifdef RPS_MIXER_SSE
+		__m128 gain = _mm_set1_ps(voice.gain);
+		for (; i + 4ull <= count; i += 4ull)
+		{
+			_mm_storeu_ps(target + i, _mm_add_ps(_mm_loadu_ps(target + i), _mm_mul_ps(_mm_loadu_ps(source + i), gain)));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			target[i] += source[i] * voice.gain;
+		}
+		voice.frame += count / channels;
+	}
+
+	// Master volume, then a Pade approximation of tanh on [-3, 3] as the soft clipper
+	void SoundMixer::resolve(size_t frames)
+	{
+		float volume = masterVolume.load(std::memory_order_relaxed);
+		size_t count = frames * channels;
+		const float* source = mixBuffer.data();
+		sf::Int16* target = outputBuffer.data();
+		size_t i = 0ull;
+
+#ifdef RPS_MIXER_SSE
+		const __m128 scale = _mm_set1_ps(volume);
+		const __m128 limit = _mm_set1_ps(3.0f);
+		const __m128 negativeLimit = _mm_set1_ps(-3.0f);
+		const __m128 k27 = _mm_set1_ps(27.0f);
+		const __m128 k9 = _mm_set1_ps(9.0f);
+		const __m128 full = _mm_set1_ps(32767.0f);
+		auto clip = [&](__m128 x)
+		{
+			x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(x, scale), negativeLimit), limit);
+			__m128 x2 = _mm_mul_ps(x, x);
+			__m128 y = _mm_div_ps(_mm_mul_ps(x, _mm_add_ps(k27, x2)), _mm_add_ps(k27, _mm_mul_ps(k9, x2)));
+			return _mm_cvtps_epi32(_mm_mul_ps(y, full));
+		};
+		for (; i + 8ull <= count; i += 8ull)
+		{
+			__m128i low = clip(_mm_loadu_ps(source + i));
+			__m128i high = clip(_mm_loadu_ps(source + i + 4ull));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(target + i), _mm_packs_epi32(low, high));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			float x = std::fmax(-3.0f, std::fmin(source[i] * volume, 3.0f));
+			float y = x * (27.0f + x * x) / (27.0f + 9.0f * x * x);
+			target[i] = static_cast<sf::Int16>(std::lround(y * 32767.0f));
+		}
+	}
+
+	bool SoundMixer::onGetData(Chunk& chunk)
+	{
+		ALLOC_PHASE(Audio);
+		if (isStopRequested.exchange(false))
+			voiceCount = 0ull;
+		startVoices();
+
+		std::fill(mixBuffer.begin(), mixBuffer.end(), 0.0f);
+		for (size_t v = 0ull; v < voiceCount;)
+		{
+			mixVoice(voices[v], blockFrames);
+			if (voices[v].frame >= clips[voices[v].clip].frames)
+				voices[v] = voices[--voiceCount];
+			else
+				++v;
+		}
+		resolve(blockFrames);
+		activeVoices.store(voiceCount, std::memory_order_relaxed);
+
+		chunk.samples = outputBuffer.data();
+		chunk.sampleCount = outputBuffer.size();
+		return true;
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <SFML/Audio.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+namespace rps
+{
+	// Software mixer behind a single sf::SoundStream (one OpenAL source for every effect).
+	// Clips are converted once to float PCM in the output format; each block sums every
+	// active voice with SIMD accumulation, then applies the master volume and a soft clip.
+	// The per-block cost is bounded by the voice limit, not by how many sounds were triggered.
+	class SoundMixer : public sf::SoundStream
+	{
+	public:
+		SoundMixer();
+		~SoundMixer();
+
+		void setup(unsigned int channelCount, unsigned int sampleRate, size_t maxVoices, size_t blockFrames);
+		size_t addClip(const sf::SoundBuffer&);
+
+		// Safe from one producer thread at a time; never blocks, drops the trigger when the queue is full
+		void trigger(size_t clip, float gain = 1.0f);
+		void stopVoices();
+
+		void setMasterVolume(float volume);
+		void setVoiceLimit(size_t);
+
+		size_t getActiveVoices() const { return activeVoices.load(std::memory_order_relaxed); }
+		uint64_t getDroppedVoices() const { return droppedVoices.load(std::memory_order_relaxed); }
+
+	protected:
+		bool onGetData(Chunk&) override;
+		void onSeek(sf::Time) override;
+
+	private:
+		struct Clip
+		{
+			std::vector<float> samples;
+			size_t frames;
+		};
+
+		struct Voice
+		{
+			uint32_t clip;
+			size_t frame;
+			float gain;
+		};
+
+		struct Trigger
+		{
+			uint32_t clip;
+			float gain;
+		};
+
+		unsigned int channels;
+		unsigned int rate;
+		size_t blockFrames;
+
+		std::vector<Clip> clips;
+		std::vector<Voice> voices;
+		size_t voiceCount;
+		std::vector<float> mixBuffer;
+		std::vector<sf::Int16> outputBuffer;
+
+		static const size_t triggerCapacity = 4096ull;
+		std::unique_ptr<Trigger[]> triggers;
+		std::atomic<size_t> triggerHead;
+		std::atomic<size_t> triggerTail;
+
+		std::atomic<float> masterVolume;
+		std::atomic<size_t> voiceLimit;
+		std::atomic<size_t> activeVoices;
+		std::atomic<uint64_t> droppedVoices;
+		std::atomic<bool> isStopRequested;
+
+		void startVoices();
+		void mixVoice(Voice&, size_t frames);
+		void resolve(size_t frames);
+	};
+}
@@ -0,0 +1,181 @@
+#include "Tracer.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+
+namespace rps
+{
+	namespace
+	{
+		struct TraceRecord
+		{
+			const char* name;
+			int64_t timestamp;
+			int64_t duration;
+			double value;
+			char phase;
+		};
+
+		// Chunks are only ever appended by their own thread and published through `count`,
+		// so stop() can read them while other threads are still running
+		struct TraceChunk
+		{
+			static const size_t capacity = 4096ull;
+			TraceRecord records[capacity];
+			std::atomic<size_t> count{ 0ull };
+			std::atomic<TraceChunk*> next{ nullptr };
+		};
+
+		struct ThreadBuffer
+		{
+			uint32_t threadId;
+			std::atomic<const char*> threadName{ nullptr };
+			TraceChunk* first;
+			TraceChunk* last;
+		};
+
+		std::mutex buffersMutex;
+		std::vector<ThreadBuffer*> buffers;
+		std::string outputName;
+		std::chrono::steady_clock::time_point origin;
+		std::atomic<uint32_t> nextThreadId{ 1u };
+		thread_local ThreadBuffer* threadBuffer = nullptr;
+
+		ThreadBuffer& getThreadBuffer()
+		{
+			if (threadBuffer == nullptr)
+			{
+				threadBuffer = new ThreadBuffer;
+				threadBuffer->threadId = nextThreadId.fetch_add(1u, std::memory_order_relaxed);
+				threadBuffer->first = new TraceChunk;
+				threadBuffer->last = threadBuffer->first;
+
+				std::lock_guard<std::mutex> lock(buffersMutex);
+				buffers.push_back(threadBuffer);
+			}
+			return *threadBuffer;
+		}
+
+		void append(const TraceRecord& record)
+		{
+			ThreadBuffer& buffer = getThreadBuffer();
+			TraceChunk* chunk = buffer.last;
+			size_t count = chunk->count.load(std::memory_order_relaxed);
+			if (count == TraceChunk::capacity)
+			{
+				TraceChunk* fresh = new TraceChunk;
+				chunk->next.store(fresh, std::memory_order_release);
+				buffer.last = fresh;
+				chunk = fresh;
+				count = 0ull;
+			}
+			chunk->records[count] = record;
+			chunk->count.store(count + 1ull, std::memory_order_release);
+		}
+	}
+
+	std::atomic<bool> Tracer::enabled{ false };
+
+	bool Tracer::start(const std::string& fileName)
+	{
+		std::ofstream probe(fileName);
+		if (!probe)
+		{
+			std::cout << "Failed to open " << fileName << " for tracing" << std::endl;
+			return false;
+		}
+		outputName = fileName;
+		origin = std::chrono::steady_clock::now();
+		enabled.store(true);
+		setThreadName("Main");
+		return true;
+	}
+
+	int64_t Tracer::now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+	}
+
+	void Tracer::begin(const char* name)
+	{
+		if (!isEnabled())
+			return;
+		append(TraceRecord{ name, now(), 0ll, 0.0, 'B' });
+	}
+
+	void Tracer::end(const char* name)
+	{
+		if (!isEnabled())
+			return;
+		append(TraceRecord{ name, now(), 0ll, 0.0, 'E' });
+	}
+
+	void Tracer::complete(const char* name, int64_t begin, int64_t end)
+	{
+		append(TraceRecord{ name, begin, end - begin, 0.0, 'X' });
+	}
+
+	void Tracer::counter(const char* name, double value)
+	{
+		if (!isEnabled())
+			return;
+		append(TraceRecord{ name, now(), 0ll, value, 'C' });
+	}
+
+	void Tracer::setThreadName(const char* name)
+	{
+		getThreadBuffer().threadName.store(name, std::memory_order_relaxed);
+	}
+
+	void Tracer::stop()
+	{
+		if (!enabled.exchange(false))
+			return;
+
+		std::ofstream file(outputName);
+		file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+
+		bool isFirst = true;
+		auto separate = [&]()
+		{
+			file << (isFirst ? "\n" : ",\n");
+			isFirst = false;
+		};
+
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		for (auto buffer : buffers)
+		{
+			const char* threadName = buffer->threadName.load(std::memory_order_relaxed);
+			if (threadName != nullptr)
+			{
+				separate();
+				file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+					<< ",\"args\":{\"name\":\"" << threadName << "\"}}";
+			}
+
+			for (TraceChunk* chunk = buffer->first; chunk != nullptr; chunk = chunk->next.load(std::memory_order_acquire))
+			{
+				size_t count = chunk->count.load(std::memory_order_acquire);
+				for (size_t i = 0ull; i < count; ++i)
+				{
+					const TraceRecord& record = chunk->records[i];
+					separate();
+					file << "{\"name\":\"" << record.name << "\",\"ph\":\"" << record.phase
+						<< "\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"ts\":" << record.timestamp / 1000.0;
+					if (record.phase == 'X')
+						file << ",\"dur\":" << record.duration / 1000.0 << '}';
+					else if (record.phase == 'C')
+						file << ",\"args\":{\"value\":" << record.value << "}}";
+					else
+						file << '}';
+				}
+			}
+		}
+		file << "\n]}\n";
+		std::cout << "Trace was saved to " << outputName << std::endl;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+// Spans and counters written as Chrome Trace Event JSON (chrome://tracing, ui.perfetto.dev).
+// Compiled only with RPS_ENABLE_TRACING; otherwise every macro expands to nothing.
+// Names must be string literals: records keep the pointer, not a copy.
+#ifdef RPS_ENABLE_TRACING
+#define RPS_TRACE_JOIN_IMPL(a, b) a##b
+#define RPS_TRACE_JOIN(a, b) RPS_TRACE_JOIN_IMPL(a, b)
+#define TRACE_SCOPE(name) rps::TraceScope RPS_TRACE_JOIN(traceScope, __LINE__)(name)
+#define TRACE_BEGIN(name) rps::Tracer::begin(name)
+#define TRACE_END(name) rps::Tracer::end(name)
+#define TRACE_COUNTER(name, value) rps::Tracer::counter(name, static_cast<double>(value))
+#define TRACE_THREAD_NAME(name) rps::Tracer::setThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+
+namespace rps
+{
+	class Tracer
+	{
+	public:
+		static bool start(const std::string& fileName);
+		static void stop();
+
+		static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+		static int64_t now();
+
+		static void begin(const char* name);
+		static void end(const char* name);
+		static void complete(const char* name, int64_t begin, int64_t end);
+		static void counter(const char* name, double value);
+		static void setThreadName(const char* name);
+
+	private:
+		static std::atomic<bool> enabled;
+	};
+
+
+	class TraceScope
+	{
+	public:
+		explicit TraceScope(const char* scopeName)
+			: name(scopeName), begin(Tracer::isEnabled() ? Tracer::now() : -1ll)
+		{
+		}
+
+		~TraceScope()
+		{
+			if (begin >= 0ll && Tracer::isEnabled())
+				Tracer::complete(name, begin, Tracer::now());
+		}
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+	private:
+		const char* name;
+		int64_t begin;
+	};
+}
@@ -1,10 +1,149 @@
 #include "Engine.hpp"
+#include "ForkRunner.hpp"
+#include "AllocTest.hpp"
 
+#include <cctype>
+#include <stdexcept>
 
-int main()
+
+void printUsage()
+{
+    std::cout << "Usage: Rock_Paper_Scissors [options]\n"
+        "  --load <file>                 start from a snapshot\n"
+        "  --trace <file>                write a Chrome trace\n"
+        "  --fork <file>                 continue a snapshot headless as several matches\n"
+        "  --forks <n>                   number of continuations\n"
+        "  --ticks <n>                   ticks per continuation\n"
+        "  --speed-spread <x>            speed spread across continuations\n"
+        "  --size-spread <x>             size spread across continuations\n"
+        "  --save-forks                  save every continuation's final state\n"
+        "  --alloc-test                  check that simulation ticks do not allocate\n"
+        "  --alloc-ticks <n>             measured ticks per steering mode\n"
+        "  --count <n>                   objects per type for the alloc test\n"
+        "  --threads <n>                 job system threads for headless runs\n"
+        "  --step <seconds>              time step for headless runs\n"
+        "  --arenas <n>                  run n matches side by side\n"
+        "  --arena-speed-spread <x>      speed spread across arenas\n"
+        "  --arena-size-spread <x>       size spread across arenas\n"
+        "  --arena-same-seed             give every arena the same seed" << std::endl;
+}
+
+// std::stoull wraps a leading '-' around and stops at the first non-digit, so both are rejected here
+size_t parseCount(const std::string& text)
+{
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0])))
+        throw std::invalid_argument(text);
+    size_t length = 0ull;
+    size_t count = std::stoull(text, &length);
+    if (length != text.size())
+        throw std::invalid_argument(text);
+    return count;
+}
+
+int main(int argc, char* argv[])
 {
-    rps::Engine engine{};
-    engine.run();
+    std::string traceFile;
+    std::string snapshotFile;
+    rps::ForkConfig forkConfig;
+    rps::ArenaConfig arenaConfig;
+    rps::AllocTestConfig allocTestConfig;
+    bool isAllocTest = false;
+    size_t allocTestCount = 0ull;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--trace" && i + 1 < argc)
+                traceFile = argv[++i];
+            else if (arg == "--load" && i + 1 < argc)
+                snapshotFile = argv[++i];
+            else if (arg == "--fork" && i + 1 < argc)
+                forkConfig.snapshotName = argv[++i];
+            else if (arg == "--forks" && i + 1 < argc)
+                forkConfig.forks = parseCount(argv[++i]);
+            else if (arg == "--threads" && i + 1 < argc)
+                forkConfig.threads = parseCount(argv[++i]);
+            else if (arg == "--ticks" && i + 1 < argc)
+                forkConfig.ticks = parseCount(argv[++i]);
+            else if (arg == "--step" && i + 1 < argc)
+                forkConfig.timeStep = std::stof(argv[++i]);
+            else if (arg == "--speed-spread" && i + 1 < argc)
+                forkConfig.speedSpread = std::stof(argv[++i]);
+            else if (arg == "--size-spread" && i + 1 < argc)
+                forkConfig.sizeSpread = std::stof(argv[++i]);
+            else if (arg == "--save-forks")
+                forkConfig.isSaveForks = true;
+            else if (arg == "--alloc-test")
+                isAllocTest = true;
+            else if (arg == "--alloc-ticks" && i + 1 < argc)
+                allocTestConfig.ticks = parseCount(argv[++i]);
+            else if (arg == "--count" && i + 1 < argc)
+                allocTestCount = parseCount(argv[++i]);
+            else if (arg == "--arenas" && i + 1 < argc)
+                arenaConfig.arenas = parseCount(argv[++i]);
+            else if (arg == "--arena-speed-spread" && i + 1 < argc)
+                arenaConfig.speedSpread = std::stof(argv[++i]);
+            else if (arg == "--arena-size-spread" && i + 1 < argc)
+                arenaConfig.sizeSpread = std::stof(argv[++i]);
+            else if (arg == "--arena-same-seed")
+                arenaConfig.isSameSeed = true;
+            else
+            {
+                std::cout << "Unknown option or missing value: " << arg << std::endl;
+                printUsage();
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        std::cout << "Invalid option value" << std::endl;
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    if (!snapshotFile.empty() && arenaConfig.arenas > 1ull && !isAllocTest && forkConfig.snapshotName.empty())
+    {
+        std::cout << "--load cannot be combined with --arenas" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!traceFile.empty())
+    {
+#ifdef RPS_ENABLE_TRACING
+        rps::Tracer::start(traceFile);
+#else
+        std::cout << "--trace ignored: built without RPS_ENABLE_TRACING" << std::endl;
+#endif
+    }
+
+    if (isAllocTest)
+    {
+        allocTestConfig.snapshotName = snapshotFile;
+        allocTestConfig.simulation = rps::getSimulationConfig(rps::GameSettings());
+        if (allocTestCount != 0ull)
+            allocTestConfig.simulation.count = allocTestCount;
+        allocTestConfig.timeStep = forkConfig.timeStep;
+        allocTestConfig.threads = forkConfig.threads;
+
+        bool isSuccess = rps::runAllocTest(allocTestConfig);
+        rps::Tracer::stop();
+        return isSuccess ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (!forkConfig.snapshotName.empty())
+    {
+        bool isSuccess = rps::runForks(forkConfig);
+        rps::Tracer::stop();
+        return isSuccess ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    {
+        rps::Engine engine{ snapshotFile, arenaConfig };
+        engine.run();
+    }
 
+    rps::Tracer::stop();
     return EXIT_SUCCESS;
 }